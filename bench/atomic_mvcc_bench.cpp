@@ -0,0 +1,108 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+
+// Cost of current(), overwrite() and update() on mvcc (heap snapshot and
+// shared_ptr per publish) versus atomic_mvcc (one packed word) for several
+// value types, single threaded and with concurrent updaters. Types too wide
+// for atomic_mvcc show what mvcc_for falls back to.
+//
+// Usage: atomic_mvcc_bench [iterations] [threads]
+
+#include <mvcc11/mvcc.hpp>
+#include <mvcc11/atomic_mvcc.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+using namespace mvcc11;
+
+namespace
+{
+  template <class Op>
+  void measure(char const *name, size_t iterations, size_t threads, Op op)
+  {
+    vector<thread> workers;
+    auto const start = high_resolution_clock::now();
+    for(size_t t = 0; t < threads; ++t)
+    {
+      workers.emplace_back([&] {
+          for(size_t i = 0; i < iterations; ++i)
+            op(i);
+        });
+    }
+    for(auto &w : workers)
+      w.join();
+    auto const elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+    printf("%-34s %8.1f ns/op\n",
+           name,
+           static_cast<double>(elapsed.count()) / (iterations * threads));
+  }
+
+  template <class Mvcc>
+  void run(char const *name, size_t iterations, size_t threads)
+  {
+    using value_type = typename Mvcc::value_type;
+
+    Mvcc x{value_type{}};
+    volatile value_type sink{};
+    char label[64];
+
+    snprintf(label, sizeof(label), "%s current()", name);
+    measure(label, iterations, threads, [&](size_t) { sink = x.current()->value; });
+
+    snprintf(label, sizeof(label), "%s overwrite()", name);
+    measure(label, iterations, threads, [&](size_t i) { x.overwrite(static_cast<value_type>(i)); });
+
+    snprintf(label, sizeof(label), "%s update()", name);
+    measure(label, iterations, threads, [&](size_t) {
+        x.update([](size_t, value_type value) { return static_cast<value_type>(value + 1); });
+      });
+
+    (void)sink;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  size_t const iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+  size_t const threads = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+
+  printf("iterations %zu, threads %zu, atomic_mvcc<int> lock-free: %s\n",
+         iterations,
+         threads,
+         atomic_mvcc<int>{}.is_lock_free() ? "yes" : "no");
+
+  run<mvcc<int>>("mvcc<int>", iterations, threads);
+  run<atomic_mvcc<int>>("atomic_mvcc<int>", iterations, threads);
+  run<mvcc<uint16_t>>("mvcc<uint16_t>", iterations, threads);
+  run<atomic_mvcc<uint16_t>>("atomic_mvcc<uint16_t>", iterations, threads);
+  run<mvcc<float>>("mvcc<float>", iterations, threads);
+  run<atomic_mvcc<float>>("atomic_mvcc<float>", iterations, threads);
+
+  // Both are mvcc, since a 16-byte word would not be lock-free.
+  run<mvcc_for<double>>("mvcc_for<double>", iterations, threads);
+  run<mvcc_for<int64_t>>("mvcc_for<int64_t>", iterations, threads);
+
+  return 0;
+}
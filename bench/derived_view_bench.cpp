@@ -0,0 +1,106 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+
+// Cost per request of deriving a sorted index from the current snapshot,
+// recomputed on every request versus memoized with snapshot::derived(),
+// while a new version is published every `requests_per_version` requests.
+//
+// Usage: derived_view_bench [elements] [requests] [requests_per_version]
+
+#include <mvcc11/mvcc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+using namespace mvcc11;
+
+namespace
+{
+  struct sorted_index
+  {
+    vector<int> operator()(size_t, vector<int> const &value) const
+    {
+      vector<int> sorted(value);
+      sort(sorted.begin(), sorted.end());
+      return sorted;
+    }
+  };
+
+  template <class Request>
+  void run(char const *name, size_t elements, size_t requests, size_t requests_per_version, Request request)
+  {
+    mt19937 random{42};
+    auto make_value = [&] {
+        vector<int> value(elements);
+        for(auto &v : value)
+          v = static_cast<int>(random());
+        return value;
+      };
+
+    mvcc<vector<int>> x{make_value()};
+    long long checksum = 0;
+
+    auto const start = high_resolution_clock::now();
+    for(size_t i = 0; i < requests; ++i)
+    {
+      if(i % requests_per_version == requests_per_version - 1)
+        x.overwrite(make_value());
+
+      auto const snapshot = x.current();
+      auto const &sorted = request(*snapshot);
+      checksum += sorted[i % sorted.size()];
+    }
+    auto const elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+    printf("%-12s %10.0f ns/request  (checksum %lld)\n",
+           name,
+           static_cast<double>(elapsed.count()) / requests,
+           checksum);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  size_t const elements = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+  size_t const requests = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10000;
+  size_t const requests_per_version = max<size_t>(1, argc > 3 ? strtoul(argv[3], nullptr, 10) : 100);
+
+  printf("elements %zu, requests %zu, requests per version %zu\n",
+         elements,
+         requests,
+         requests_per_version);
+
+  // Both include publishing the new versions.
+  vector<int> scratch;
+  run("recomputed", elements, requests, requests_per_version,
+      [&](snapshot<vector<int>> const &s) -> vector<int> const & {
+        scratch = sorted_index{}(s.version, s.value);
+        return scratch;
+      });
+  run("memoized", elements, requests, requests_per_version,
+      [](snapshot<vector<int>> const &s) -> vector<int> const & {
+        return s.derived(sorted_index{});
+      });
+
+  return 0;
+}
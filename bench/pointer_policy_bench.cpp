@@ -0,0 +1,118 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+
+// Cost of current(), overwrite() and update() with each pointer policy,
+// and read throughput with readers racing a writer.
+// atomic_shared_ptr_policy is included when built as C++20.
+//
+// Usage: pointer_policy_bench [iterations] [readers]
+
+#include <mvcc11/mvcc.hpp>
+#include <mvcc11/boost_shared_ptr_policy.hpp>
+#include <mvcc11/std_shared_ptr_policy.hpp>
+#include <mvcc11/intrusive_ptr_policy.hpp>
+#ifdef __cpp_lib_atomic_shared_ptr
+#include <mvcc11/atomic_shared_ptr_policy.hpp>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+using namespace mvcc11;
+
+namespace
+{
+  template <class Op>
+  double ns_per_op(size_t iterations, Op op)
+  {
+    auto const start = high_resolution_clock::now();
+    for(size_t i = 0; i < iterations; ++i)
+      op(i);
+    auto const elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+    return static_cast<double>(elapsed.count()) / iterations;
+  }
+
+  template <class Policy>
+  void run(char const *name, size_t iterations, size_t readers)
+  {
+    mvcc<size_t, Policy> x{0};
+    atomic<size_t> sink{0};
+
+    auto const current = ns_per_op(iterations, [&](size_t) {
+        sink.fetch_add(x.current()->value, memory_order_relaxed);
+      });
+    auto const overwrite = ns_per_op(iterations, [&](size_t i) {
+        x.overwrite(i);
+      });
+    auto const update = ns_per_op(iterations, [&](size_t) {
+        x.update([](size_t, size_t value) { return value + 1; });
+      });
+
+    atomic<bool> done{false};
+    atomic<size_t> reads{0};
+    vector<thread> threads;
+    for(size_t r = 0; r < readers; ++r)
+    {
+      threads.emplace_back([&] {
+          size_t n = 0;
+          while(!done)
+          {
+            sink.fetch_add(x.current()->value, memory_order_relaxed);
+            ++n;
+          }
+          reads += n;
+        });
+    }
+    auto const start = high_resolution_clock::now();
+    for(size_t i = 0; i < iterations / 10; ++i)
+      x.overwrite(i);
+    done = true;
+    for(auto &t : threads)
+      t.join();
+    auto const elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+    printf("%-26s current %6.1f ns  overwrite %6.1f ns  update %6.1f ns  contended reads %12.0f/s\n",
+           name,
+           current,
+           overwrite,
+           update,
+           reads * 1e6 / max<long long>(1, elapsed.count()));
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  size_t const iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+  size_t const readers = argc > 2 ? strtoul(argv[2], nullptr, 10) : max(1u, thread::hardware_concurrency());
+
+  printf("iterations %zu, readers %zu\n", iterations, readers);
+
+  run<boost_shared_ptr_policy>("boost_shared_ptr_policy", iterations, readers);
+  run<std_shared_ptr_policy>("std_shared_ptr_policy", iterations, readers);
+#ifdef __cpp_lib_atomic_shared_ptr
+  run<atomic_shared_ptr_policy>("atomic_shared_ptr_policy", iterations, readers);
+#endif
+  run<intrusive_ptr_policy>("intrusive_ptr_policy", iterations, readers);
+
+  return 0;
+}
@@ -0,0 +1,183 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+
+// Read throughput of current() with a single current pointer (mvcc) and
+// with one replica per core group (replicated_mvcc), while a writer keeps
+// publishing in the background.
+//
+// For each layout it also counts cache misses per read, and optionally a
+// raw PMU event given in hex, such as the cross-socket HITM event
+// (0x04d3, MEM_LOAD_L3_MISS_RETIRED.REMOTE_HITM on Skylake-SP). Counts
+// cover the readers and the writer. They show "n/a" where the kernel or
+// hypervisor does not expose hardware counters.
+//
+// Usage: replicated_read_bench [readers] [cores_per_replica] [duration_ms] [layout] [raw_event]
+//
+// where layout is "mvcc", "replicated" or "all".
+
+#include <mvcc11/mvcc.hpp>
+#include <mvcc11/replicated_mvcc.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace chrono;
+
+using namespace mvcc11;
+
+namespace
+{
+  auto const PUBLISH_INTERVAL = microseconds(500);
+
+  // A hardware event counted over the calling thread and the threads it
+  // starts while the counter is open.
+  class counter
+  {
+  public:
+    counter(uint32_t type, uint64_t config)
+    : fd_{-1}
+    {
+      perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = type;
+      attr.config = config;
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+
+      fd_ = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+      if(fd_ >= 0)
+      {
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+    ~counter()
+    {
+      if(fd_ >= 0)
+        close(fd_);
+    }
+
+    counter(counter const &) = delete;
+    counter& operator=(counter const &) = delete;
+
+    // Formats the count per `reads`, or "n/a".
+    void format(char *buffer, size_t size, size_t reads) const
+    {
+      uint64_t count = 0;
+      if(fd_ < 0 || ::read(fd_, &count, sizeof(count)) != sizeof(count) || reads == 0)
+        snprintf(buffer, size, "n/a");
+      else
+        snprintf(buffer, size, "%.4f", static_cast<double>(count) / reads);
+    }
+
+  private:
+    int fd_;
+  };
+
+  template <class Mvcc>
+  void run(char const *name, Mvcc &x, size_t readers, milliseconds duration, uint64_t raw_event)
+  {
+    atomic<bool> done{false};
+    atomic<size_t> reads{0};
+    atomic<size_t> checksum{0};
+
+    counter misses{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+    counter raw{PERF_TYPE_RAW, raw_event};
+
+    vector<thread> threads;
+    for(size_t i = 0; i < readers; ++i)
+    {
+      threads.emplace_back([&] {
+          size_t n = 0;
+          size_t sum = 0;
+          while(!done)
+          {
+            sum += x.current()->value;
+            ++n;
+          }
+          reads += n;
+          checksum += sum;
+        });
+    }
+
+    size_t publishes = 0;
+    auto const end = high_resolution_clock::now() + duration;
+    while(high_resolution_clock::now() < end)
+    {
+      x.overwrite(publishes++);
+      this_thread::sleep_for(PUBLISH_INTERVAL);
+    }
+
+    done = true;
+    for(auto &t : threads)
+      t.join();
+
+    char misses_per_read[32];
+    misses.format(misses_per_read, sizeof(misses_per_read), reads);
+    char raw_per_read[32] = "-";
+    if(raw_event != 0)
+      raw.format(raw_per_read, sizeof(raw_per_read), reads);
+
+    auto const seconds = duration_cast<microseconds>(duration).count() / 1e6;
+    printf("%-12s %12.0f reads/s  misses/read %8s  raw/read %8s  %zu publishes  (checksum %zu)\n",
+           name,
+           reads / seconds,
+           misses_per_read,
+           raw_per_read,
+           publishes,
+           static_cast<size_t>(checksum));
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  size_t const hw = max(1u, thread::hardware_concurrency());
+  size_t const readers = argc > 1 ? strtoul(argv[1], nullptr, 10) : hw;
+  size_t const cores_per_replica = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+  auto const duration = milliseconds(argc > 3 ? strtoul(argv[3], nullptr, 10) : 1000);
+  char const *layout = argc > 4 ? argv[4] : "all";
+  uint64_t const raw_event = argc > 5 ? strtoull(argv[5], nullptr, 16) : 0;
+
+  if(!strcmp(layout, "all") || !strcmp(layout, "mvcc"))
+  {
+    mvcc<size_t> x{0};
+    run("mvcc", x, readers, duration, raw_event);
+  }
+
+  if(!strcmp(layout, "all") || !strcmp(layout, "replicated"))
+  {
+    replicated_mvcc<size_t> x{replication{cores_per_replica}, 0};
+    printf("%zu replicas of %zu cores\n", x.replica_count(), cores_per_replica);
+    run("replicated", x, readers, duration, raw_event);
+  }
+
+  return 0;
+}
@@ -0,0 +1,208 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+
+// Memory use and current() latency of reader processes that each hold
+// their own copy of a dataset in an mvcc, versus reader processes mapping
+// a single shm_mvcc published by the parent.
+//
+// Readers map the segment shared, so it does not show in their private
+// memory. It is reported on its own, once the parent has published a
+// version into every slot.
+//
+// Usage: shm_mvcc_bench [readers] [reads_per_reader] [slots]
+
+#include <mvcc11/mvcc.hpp>
+#include <mvcc11/shm_mvcc.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace chrono;
+
+using namespace mvcc11;
+
+namespace
+{
+  size_t const DATASET_WORDS = size_t{1} << 21; // 16 MiB
+  using dataset = array<uint64_t, DATASET_WORDS>;
+
+  struct reader_result
+  {
+    long private_kb;
+    double ns_per_read;
+    uint64_t checksum;
+  };
+
+  // Resident memory not shared with other processes.
+  long private_kb()
+  {
+    long size = 0, resident = 0, shared = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if(statm == nullptr)
+      return -1;
+    if(fscanf(statm, "%ld %ld %ld", &size, &resident, &shared) != 3)
+      resident = shared = 0;
+    fclose(statm);
+    return (resident - shared) * (sysconf(_SC_PAGESIZE) / 1024);
+  }
+
+  // Memory allocated to shared memory segment `name`, which lives in the
+  // tmpfs mounted on /dev/shm, so all of it is resident.
+  long segment_kb(string const &name)
+  {
+    struct stat st;
+    if(stat(("/dev/shm" + name).c_str(), &st) != 0)
+      return -1;
+    return static_cast<long>(st.st_blocks) * 512 / 1024;
+  }
+
+  template <class Mvcc>
+  reader_result read(Mvcc &x, size_t reads)
+  {
+    reader_result r{0, 0, 0};
+
+    // Touch the whole dataset once so it is resident.
+    {
+      auto snapshot = x.current();
+      for(auto word : snapshot->value)
+        r.checksum += word;
+    }
+
+    auto const start = high_resolution_clock::now();
+    for(size_t i = 0; i < reads; ++i)
+      r.checksum += x.current()->value[(i * 4099) % DATASET_WORDS];
+    auto const elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+    r.private_kb = private_kb();
+    r.ns_per_read = static_cast<double>(elapsed.count()) / reads;
+    return r;
+  }
+
+  struct vector_dataset
+  {
+    vector<uint64_t> words;
+
+    uint64_t operator[](size_t i) const { return words[i]; }
+    vector<uint64_t>::const_iterator begin() const { return words.begin(); }
+    vector<uint64_t>::const_iterator end() const { return words.end(); }
+  };
+
+  // Forks `readers` processes running `reader`, and collects their results.
+  // `shared_kb` is memory they share on top of their private memory.
+  template <class Reader>
+  void run(char const *name, size_t readers, long shared_kb, Reader reader)
+  {
+    vector<pair<pid_t, int>> children;
+    for(size_t i = 0; i < readers; ++i)
+    {
+      int fds[2];
+      if(pipe(fds) != 0)
+        exit(1);
+
+      pid_t const pid = fork();
+      if(pid == 0)
+      {
+        close(fds[0]);
+        reader_result const r = reader();
+        bool const written = write(fds[1], &r, sizeof(r)) == sizeof(r);
+        _exit(written ? 0 : 1);
+      }
+      close(fds[1]);
+      children.emplace_back(pid, fds[0]);
+    }
+
+    long total_kb = 0;
+    double ns = 0;
+    for(auto &child : children)
+    {
+      reader_result r{0, 0, 0};
+      if(::read(child.second, &r, sizeof(r)) != sizeof(r))
+        fprintf(stderr, "%s: reader %d failed\n", name, child.first);
+      close(child.second);
+      waitpid(child.first, nullptr, 0);
+
+      total_kb += r.private_kb;
+      ns += r.ns_per_read;
+    }
+
+    printf("%-20s private %8ld KiB (%6ld KiB/reader) + shared %8ld KiB = %8ld KiB  current() %6.1f ns\n",
+           name,
+           total_kb,
+           total_kb / static_cast<long>(readers),
+           shared_kb,
+           total_kb + shared_kb,
+           ns / readers);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  size_t const readers = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+  size_t const reads = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000000;
+  size_t const slots = argc > 3 ? strtoul(argv[3], nullptr, 10) : 3;
+
+  printf("dataset %zu KiB, readers %zu, reads %zu, slots %zu\n",
+         sizeof(dataset) / 1024,
+         readers,
+         reads,
+         slots);
+
+  run("per-process mvcc", readers, 0, [&] {
+      vector_dataset copy{vector<uint64_t>(DATASET_WORDS)};
+      for(size_t i = 0; i < DATASET_WORDS; ++i)
+        copy.words[i] = i;
+      mvcc<vector_dataset> x{std::move(copy)};
+      return read(x, reads);
+    });
+
+  auto const name = "/mvcc11_bench_" + to_string(getpid());
+  shm_mvcc<dataset>::remove(name.c_str());
+  {
+    unique_ptr<dataset> data{new dataset};
+    for(size_t i = 0; i < DATASET_WORDS; ++i)
+      (*data)[i] = i;
+    shm_mvcc<dataset> writer{name.c_str(), slots, *data};
+
+    // Publish into every slot, as a writer whose older snapshots are still
+    // held (here by the parent) would.
+    vector<shm_mvcc<dataset>::const_snapshot_ptr> held;
+    for(size_t i = 1; i < writer.slot_count(); ++i)
+    {
+      held.push_back(writer.current());
+      writer.overwrite(*data);
+    }
+    data.reset();
+
+    run("shm_mvcc", readers, segment_kb(name), [&] {
+        shm_mvcc<dataset> x{name.c_str()};
+        return read(x, reads);
+      });
+  }
+  shm_mvcc<dataset>::remove(name.c_str());
+
+  return 0;
+}
@@ -0,0 +1,158 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+
+// Worst-case completion time of a long-running updater racing a number of
+// short writers, comparing update() against a purely optimistic retry loop
+// (what update() used to be).
+//
+// Usage: update_fairness_bench [short_writers] [rounds] [long_update_ms]
+
+#include <mvcc11/mvcc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+using namespace mvcc11;
+
+namespace
+{
+  auto const ROUND_TIMEOUT = seconds(2);
+
+  struct result
+  {
+    microseconds worst{0};
+    microseconds total{0};
+    size_t starved = 0;
+    size_t short_writes = 0;
+  };
+
+  // Runs `rounds` long updates, each one raced by `short_writers` threads
+  // that keep overwriting and updating with trivial updaters.
+  template <class LongWriter>
+  result run(size_t short_writers, size_t rounds, milliseconds long_update, LongWriter long_writer)
+  {
+    result r;
+    mvcc<size_t> x{0};
+
+    for(size_t round = 0; round < rounds; ++round)
+    {
+      atomic<bool> done{false};
+      atomic<size_t> short_writes{0};
+
+      vector<thread> writers;
+      for(size_t i = 0; i < short_writers; ++i)
+      {
+        writers.emplace_back([&, i] {
+            while(!done)
+            {
+              if(i % 2 == 0)
+                x.overwrite(i);
+              else
+                x.try_update([](size_t, size_t value) { return value + 1; });
+              ++short_writes;
+            }
+          });
+      }
+
+      auto start = high_resolution_clock::now();
+      auto updated = long_writer(x, [&](size_t, size_t value) {
+          this_thread::sleep_for(long_update);
+          return value + 1;
+        });
+      auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+      done = true;
+      for(auto &w : writers)
+        w.join();
+
+      if(updated == nullptr)
+        ++r.starved;
+      r.worst = max(r.worst, elapsed);
+      r.total += elapsed;
+      r.short_writes += short_writes;
+    }
+
+    return r;
+  }
+
+  // Unfair baseline: retries try_update() with the usual backoff and no
+  // fallback, giving up after ROUND_TIMEOUT so a starved round still ends.
+  struct optimistic_only
+  {
+    template <class Updater>
+    mvcc<size_t>::const_snapshot_ptr operator()(mvcc<size_t> &x, Updater updater) const
+    {
+      auto deadline = high_resolution_clock::now() + ROUND_TIMEOUT;
+      while(true)
+      {
+        auto updated = x.try_update(updater);
+        if(updated != nullptr || high_resolution_clock::now() > deadline)
+          return updated;
+
+        this_thread::sleep_for(milliseconds(MVCC11_CONTENSION_BACKOFF_SLEEP_MS));
+      }
+    }
+  };
+
+  struct hybrid_update
+  {
+    template <class Updater>
+    mvcc<size_t>::const_snapshot_ptr operator()(mvcc<size_t> &x, Updater updater) const
+    {
+      return x.update(updater);
+    }
+  };
+
+  void report(char const *name, result const &r, size_t rounds)
+  {
+    printf("%-16s worst %9lld us  mean %9lld us  starved %zu/%zu  short writes %zu\n",
+           name,
+           static_cast<long long>(r.worst.count()),
+           static_cast<long long>(r.total.count() / rounds),
+           r.starved,
+           rounds,
+           r.short_writes);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  size_t const short_writers = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4;
+  size_t const rounds = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10;
+  auto const long_update = milliseconds(argc > 3 ? strtoul(argv[3], nullptr, 10) : 5);
+
+  printf("short writers %zu, rounds %zu, long update %lld ms, optimistic attempts %d\n",
+         short_writers,
+         rounds,
+         static_cast<long long>(long_update.count()),
+         MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS);
+
+  auto const optimistic = run(short_writers, rounds, long_update, optimistic_only{});
+  report("optimistic only", optimistic, rounds);
+
+  auto const hybrid = run(short_writers, rounds, long_update, hybrid_update{});
+  report("update()", hybrid, rounds);
+
+  return 0;
+}
@@ -0,0 +1,401 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+#ifndef MVCC11_ATOMIC_MVCC_HPP
+#define MVCC11_ATOMIC_MVCC_HPP
+
+#include <mvcc11/mvcc.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace mvcc11 {
+
+// A snapshot of an atomic_mvcc. Unlike snapshot<ValueType>, it carries no
+// derived views, so it stays as small and as trivially copyable as the
+// value itself. The version is only 32 bits wide and wraps around to 0
+// after 2^32 publishes.
+template <class ValueType>
+struct atomic_snapshot
+{
+  using value_type = ValueType;
+
+  std::uint32_t version;
+  value_type value;
+};
+
+// Values that fit in one lock-free atomic word next to their version.
+//
+// That is a 64-bit word with a 32-bit version, leaving at most 4 bytes for
+// the value. Wider values would need a 16-byte word, which GCC never makes
+// lock-free (even with -mcx16) and instead guards with libatomic's lock
+// table, so mvcc_for leaves those to mvcc.
+template <class ValueType>
+struct is_atomic_mvcc_eligible
+  : std::integral_constant<
+      bool,
+      std::is_trivially_copyable<ValueType>::value
+      && sizeof(ValueType) <= 4
+      && ATOMIC_LLONG_LOCK_FREE == 2>
+{};
+
+namespace detail {
+
+template <class ValueType>
+ValueType value_from_bytes(void const *bytes) MVCC11_NOEXCEPT(true)
+{
+  typename std::aligned_storage<sizeof(ValueType), alignof(ValueType)>::type storage;
+  std::memcpy(&storage, bytes, sizeof(ValueType));
+  return *reinterpret_cast<ValueType const *>(&storage);
+}
+
+// Packing of a (version, value) pair into a single 64-bit word. The version
+// takes the upper 32 bits, so it wraps around after 2^32 publishes.
+template <class ValueType>
+struct packed_word
+{
+  using type = std::uint64_t;
+
+  static type pack(std::uint32_t version, ValueType const &value) MVCC11_NOEXCEPT(true)
+  {
+    std::uint32_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(ValueType));
+    return (static_cast<type>(version) << 32) | bits;
+  }
+  static std::uint32_t version(type word) MVCC11_NOEXCEPT(true)
+  {
+    return static_cast<std::uint32_t>(word >> 32);
+  }
+  static ValueType value(type word) MVCC11_NOEXCEPT(true)
+  {
+    auto const bits = static_cast<std::uint32_t>(word);
+    return value_from_bytes<ValueType>(&bits);
+  }
+};
+
+} // namespace detail
+
+// A snapshot held by value, with the pointer-like interface of
+// mvcc<ValueType>::const_snapshot_ptr so code can be written against
+// either. A default constructed (or failed try_update) one is null.
+//
+// Two non-null inline_snapshot_ptrs compare equal when they hold the same
+// version, i.e. the same snapshot of one atomic_mvcc, or two that are a
+// multiple of 2^32 publishes apart.
+template <class ValueType>
+class inline_snapshot_ptr
+{
+public:
+  using element_type = atomic_snapshot<ValueType> const;
+
+  inline_snapshot_ptr() MVCC11_NOEXCEPT(true);
+  inline_snapshot_ptr(std::nullptr_t) MVCC11_NOEXCEPT(true);
+  inline_snapshot_ptr(std::uint32_t version, ValueType const &value) MVCC11_NOEXCEPT(true);
+
+  element_type* get() const MVCC11_NOEXCEPT(true);
+  element_type& operator*() const MVCC11_NOEXCEPT(true);
+  element_type* operator->() const MVCC11_NOEXCEPT(true);
+
+  explicit operator bool() const MVCC11_NOEXCEPT(true);
+
+  friend bool operator==(inline_snapshot_ptr const &lhs, inline_snapshot_ptr const &rhs) MVCC11_NOEXCEPT(true)
+  {
+    if(lhs.engaged_ != rhs.engaged_)
+      return false;
+    return !lhs.engaged_ || lhs.snapshot_.version == rhs.snapshot_.version;
+  }
+  friend bool operator!=(inline_snapshot_ptr const &lhs, inline_snapshot_ptr const &rhs) MVCC11_NOEXCEPT(true)
+  {
+    return !(lhs == rhs);
+  }
+
+private:
+  static ValueType null_value() MVCC11_NOEXCEPT(true);
+
+  bool engaged_;
+  atomic_snapshot<ValueType> snapshot_;
+};
+
+// A lock-free mvcc for small trivially copyable values.
+//
+// Version and value are packed into one atomic word, so publishing does
+// not allocate, and current(), overwrite() and update() are a load or a
+// CAS loop on that word. Snapshots are returned by value.
+//
+// Since a failed CAS means another writer made progress, update() and
+// try_update_xxx() retry right away instead of backing off.
+//
+// With a 32-bit version, that CAS is subject to ABA: an attempt that
+// stalls for exactly a multiple of 2^32 publishes, which leave the same
+// value behind, still commits although its updater saw a stale snapshot.
+// At tens of nanoseconds per publish, that takes a stall of over a minute.
+template <class ValueType>
+class atomic_mvcc
+{
+  static_assert(is_atomic_mvcc_eligible<ValueType>::value,
+                "atomic_mvcc requires a trivially copyable value of at most 4 bytes");
+
+public:
+  using value_type = ValueType;
+  using snapshot_type = atomic_snapshot<value_type>;
+  using const_snapshot_ptr = inline_snapshot_ptr<value_type>;
+
+  atomic_mvcc() MVCC11_NOEXCEPT(true);
+
+  atomic_mvcc(value_type const &value) MVCC11_NOEXCEPT(true);
+
+  atomic_mvcc(atomic_mvcc const &other) MVCC11_NOEXCEPT(true);
+
+  ~atomic_mvcc() = default;
+
+  atomic_mvcc& operator=(atomic_mvcc const &other) MVCC11_NOEXCEPT(true);
+
+  bool is_lock_free() const MVCC11_NOEXCEPT(true);
+
+  const_snapshot_ptr current() MVCC11_NOEXCEPT(true);
+  const_snapshot_ptr operator*() MVCC11_NOEXCEPT(true);
+  const_snapshot_ptr operator->() MVCC11_NOEXCEPT(true);
+
+  const_snapshot_ptr overwrite(value_type const &value) MVCC11_NOEXCEPT(true);
+
+  template <class Updater>
+  const_snapshot_ptr update(Updater updater);
+
+  template <class Updater>
+  const_snapshot_ptr try_update(Updater updater);
+
+  template <class Updater, class Clock, class Duration>
+  const_snapshot_ptr try_update_until(
+    Updater updater,
+    std::chrono::time_point<Clock, Duration> const &timeout_time);
+
+  template <class Updater, class Rep, class Period>
+  const_snapshot_ptr try_update_for(
+    Updater updater,
+    std::chrono::duration<Rep, Period> const &timeout_duration);
+
+private:
+  using packed = detail::packed_word<value_type>;
+  using word_type = typename packed::type;
+
+  template <class Updater>
+  const_snapshot_ptr try_update_impl(Updater &updater);
+
+  static const_snapshot_ptr unpack(word_type word) MVCC11_NOEXCEPT(true);
+
+  std::atomic<word_type> word_;
+};
+
+// Picks atomic_mvcc when ValueType qualifies, mvcc otherwise.
+template <class ValueType>
+using mvcc_for =
+  typename std::conditional<
+    is_atomic_mvcc_eligible<ValueType>::value,
+    atomic_mvcc<ValueType>,
+    mvcc<ValueType>>::type;
+
+template <class ValueType>
+inline_snapshot_ptr<ValueType>::inline_snapshot_ptr() MVCC11_NOEXCEPT(true)
+: engaged_{false}
+, snapshot_{0, null_value()}
+{}
+template <class ValueType>
+inline_snapshot_ptr<ValueType>::inline_snapshot_ptr(std::nullptr_t) MVCC11_NOEXCEPT(true)
+: inline_snapshot_ptr{}
+{}
+template <class ValueType>
+inline_snapshot_ptr<ValueType>::inline_snapshot_ptr(std::uint32_t version, ValueType const &value) MVCC11_NOEXCEPT(true)
+: engaged_{true}
+, snapshot_{version, value}
+{}
+
+template <class ValueType>
+auto inline_snapshot_ptr<ValueType>::get() const MVCC11_NOEXCEPT(true) -> element_type *
+{
+  return engaged_ ? &snapshot_ : nullptr;
+}
+template <class ValueType>
+auto inline_snapshot_ptr<ValueType>::operator*() const MVCC11_NOEXCEPT(true) -> element_type &
+{
+  return snapshot_;
+}
+template <class ValueType>
+auto inline_snapshot_ptr<ValueType>::operator->() const MVCC11_NOEXCEPT(true) -> element_type *
+{
+  return &snapshot_;
+}
+template <class ValueType>
+inline_snapshot_ptr<ValueType>::operator bool() const MVCC11_NOEXCEPT(true)
+{
+  return engaged_;
+}
+template <class ValueType>
+ValueType inline_snapshot_ptr<ValueType>::null_value() MVCC11_NOEXCEPT(true)
+{
+  unsigned char const zeros[sizeof(ValueType)] = {};
+  return detail::value_from_bytes<ValueType>(zeros);
+}
+
+
+template <class ValueType>
+atomic_mvcc<ValueType>::atomic_mvcc() MVCC11_NOEXCEPT(true)
+: word_{packed::pack(0, value_type{})}
+{}
+template <class ValueType>
+atomic_mvcc<ValueType>::atomic_mvcc(value_type const &value) MVCC11_NOEXCEPT(true)
+: word_{packed::pack(0, value)}
+{}
+template <class ValueType>
+atomic_mvcc<ValueType>::atomic_mvcc(atomic_mvcc const &other) MVCC11_NOEXCEPT(true)
+: word_{other.word_.load(std::memory_order_acquire)}
+{}
+
+template <class ValueType>
+auto atomic_mvcc<ValueType>::operator=(atomic_mvcc const &other) MVCC11_NOEXCEPT(true) -> atomic_mvcc &
+{
+  word_.store(other.word_.load(std::memory_order_acquire), std::memory_order_release);
+
+  return *this;
+}
+
+template <class ValueType>
+bool atomic_mvcc<ValueType>::is_lock_free() const MVCC11_NOEXCEPT(true)
+{
+  return word_.is_lock_free();
+}
+
+template <class ValueType>
+auto atomic_mvcc<ValueType>::current() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  return unpack(word_.load(std::memory_order_acquire));
+}
+template <class ValueType>
+auto atomic_mvcc<ValueType>::operator*() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  return this->current();
+}
+template <class ValueType>
+auto atomic_mvcc<ValueType>::operator->() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  return this->current();
+}
+
+template <class ValueType>
+auto atomic_mvcc<ValueType>::overwrite(value_type const &value) MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  auto expected = word_.load(std::memory_order_relaxed);
+  while(true)
+  {
+    auto const desired = packed::pack(packed::version(expected) + 1, value);
+
+    auto const overwritten =
+      word_.compare_exchange_weak(
+        expected,
+        desired,
+        std::memory_order_acq_rel,
+        std::memory_order_relaxed);
+
+    if(overwritten)
+      return unpack(desired);
+  }
+}
+
+template <class ValueType>
+template <class Updater>
+auto atomic_mvcc<ValueType>::update(Updater updater) -> const_snapshot_ptr
+{
+  while(true)
+  {
+    auto updated = this->try_update_impl(updater);
+    if(updated != nullptr)
+      return updated;
+  }
+}
+
+template <class ValueType>
+template <class Updater>
+auto atomic_mvcc<ValueType>::try_update(Updater updater) -> const_snapshot_ptr
+{
+  return this->try_update_impl(updater);
+}
+
+template <class ValueType>
+template <class Updater, class Clock, class Duration>
+auto atomic_mvcc<ValueType>::try_update_until(
+  Updater updater,
+  std::chrono::time_point<Clock, Duration> const &timeout_time)
+  -> const_snapshot_ptr
+{
+  while(true)
+  {
+    auto updated = this->try_update_impl(updater);
+
+    if(updated != nullptr)
+      return updated;
+
+    if(Clock::now() > timeout_time)
+      return nullptr;
+  }
+}
+
+template <class ValueType>
+template <class Updater, class Rep, class Period>
+auto atomic_mvcc<ValueType>::try_update_for(
+  Updater updater,
+  std::chrono::duration<Rep, Period> const &timeout_duration)
+  -> const_snapshot_ptr
+{
+  auto timeout_time = std::chrono::high_resolution_clock::now() + timeout_duration;
+  return this->try_update_until(updater, timeout_time);
+}
+
+template <class ValueType>
+template <class Updater>
+auto atomic_mvcc<ValueType>::try_update_impl(Updater &updater) -> const_snapshot_ptr
+{
+  auto expected = word_.load(std::memory_order_acquire);
+  auto const const_expected_version = packed::version(expected);
+  auto const const_expected_value = packed::value(expected);
+
+  auto const desired =
+    packed::pack(
+      const_expected_version + 1,
+      updater(const_expected_version, const_expected_value));
+
+  auto const updated =
+    word_.compare_exchange_strong(
+      expected,
+      desired,
+      std::memory_order_acq_rel,
+      std::memory_order_relaxed);
+
+  if(updated)
+    return unpack(desired);
+
+  return nullptr;
+}
+
+template <class ValueType>
+auto atomic_mvcc<ValueType>::unpack(word_type word) MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  return const_snapshot_ptr{packed::version(word), packed::value(word)};
+}
+
+} // namespace mvcc11
+
+#endif // MVCC11_ATOMIC_MVCC_HPP
@@ -0,0 +1,68 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+#ifndef MVCC11_ATOMIC_SHARED_PTR_POLICY_HPP
+#define MVCC11_ATOMIC_SHARED_PTR_POLICY_HPP
+
+#include <mvcc11/config.hpp>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#ifndef __cpp_lib_atomic_shared_ptr
+#error "atomic_shared_ptr_policy requires C++20 std::atomic<std::shared_ptr>"
+#endif
+
+namespace mvcc11 {
+
+// Snapshots held by std::shared_ptr, published through a C++20
+// std::atomic<std::shared_ptr>.
+struct atomic_shared_ptr_policy
+{
+  template <class T>
+  using pointer = std::shared_ptr<T>;
+
+  template <class T>
+  using atomic_pointer = std::atomic<std::shared_ptr<T>>;
+
+  template <class T, class... Args>
+  static pointer<T> make(Args&&... args)
+  {
+    return std::make_shared<T>(std::forward<Args>(args)...);
+  }
+
+  template <class T>
+  static pointer<T> load(atomic_pointer<T> const &p) MVCC11_NOEXCEPT(true)
+  {
+    return p.load();
+  }
+
+  template <class T>
+  static void store(atomic_pointer<T> &p, pointer<T> desired) MVCC11_NOEXCEPT(true)
+  {
+    p.store(std::move(desired));
+  }
+
+  template <class T>
+  static bool compare_exchange_strong(atomic_pointer<T> &p, pointer<T> &expected, pointer<T> desired) MVCC11_NOEXCEPT(true)
+  {
+    return p.compare_exchange_strong(expected, std::move(desired));
+  }
+};
+
+} // namespace mvcc11
+
+#endif // MVCC11_ATOMIC_SHARED_PTR_POLICY_HPP
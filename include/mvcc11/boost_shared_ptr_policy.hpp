@@ -0,0 +1,65 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+#ifndef MVCC11_BOOST_SHARED_PTR_POLICY_HPP
+#define MVCC11_BOOST_SHARED_PTR_POLICY_HPP
+
+#include <mvcc11/config.hpp>
+
+#include <boost/smart_ptr/shared_ptr.hpp>
+#include <boost/smart_ptr/make_shared.hpp>
+
+#include <utility>
+
+namespace mvcc11 {
+
+// Snapshots held by boost::shared_ptr, published with boost's atomic
+// shared_ptr free functions.
+struct boost_shared_ptr_policy
+{
+  template <class T>
+  using pointer = boost::shared_ptr<T>;
+
+  template <class T>
+  using atomic_pointer = boost::shared_ptr<T>;
+
+  template <class T, class... Args>
+  static pointer<T> make(Args&&... args)
+  {
+    return boost::make_shared<T>(std::forward<Args>(args)...);
+  }
+
+  template <class T>
+  static pointer<T> load(atomic_pointer<T> const &p) MVCC11_NOEXCEPT(true)
+  {
+    return boost::atomic_load(&p);
+  }
+
+  template <class T>
+  static void store(atomic_pointer<T> &p, pointer<T> desired) MVCC11_NOEXCEPT(true)
+  {
+    boost::atomic_store(&p, std::move(desired));
+  }
+
+  template <class T>
+  static bool compare_exchange_strong(atomic_pointer<T> &p, pointer<T> &expected, pointer<T> desired) MVCC11_NOEXCEPT(true)
+  {
+    return boost::atomic_compare_exchange(&p, &expected, std::move(desired));
+  }
+};
+
+} // namespace mvcc11
+
+#endif // MVCC11_BOOST_SHARED_PTR_POLICY_HPP
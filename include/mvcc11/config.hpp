@@ -0,0 +1,25 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+#ifndef MVCC11_CONFIG_HPP
+#define MVCC11_CONFIG_HPP
+
+#ifdef MVCC11_DISABLE_NOEXCEPT
+#define MVCC11_NOEXCEPT(COND)
+#else
+#define MVCC11_NOEXCEPT(COND) noexcept(COND)
+#endif
+
+#endif // MVCC11_CONFIG_HPP
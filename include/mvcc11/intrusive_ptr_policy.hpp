@@ -0,0 +1,405 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+#ifndef MVCC11_INTRUSIVE_PTR_POLICY_HPP
+#define MVCC11_INTRUSIVE_PTR_POLICY_HPP
+
+#include <mvcc11/config.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace mvcc11 {
+
+namespace detail {
+
+// The object and its 32-bit reference count in a single allocation.
+template <class T>
+struct intrusive_node
+{
+  template <class... Args>
+  intrusive_node(Args&&... args)
+  : refs{1}
+  , value(std::forward<Args>(args)...)
+  {}
+
+  std::atomic<std::uint32_t> refs;
+  T value;
+};
+
+} // namespace detail
+
+template <class T>
+class atomic_intrusive_ptr;
+
+// A shared pointer to an object allocated along with its reference count,
+// so there is no separate control block and no weak count.
+template <class T>
+class intrusive_ptr
+{
+public:
+  using element_type = T;
+
+  intrusive_ptr() MVCC11_NOEXCEPT(true);
+  intrusive_ptr(std::nullptr_t) MVCC11_NOEXCEPT(true);
+
+  intrusive_ptr(intrusive_ptr const &other) MVCC11_NOEXCEPT(true);
+  intrusive_ptr(intrusive_ptr &&other) MVCC11_NOEXCEPT(true);
+
+  // intrusive_ptr<T> converts to intrusive_ptr<T const>
+  template <
+    class U,
+    class = typename std::enable_if<std::is_same<U const, T>::value>::type>
+  intrusive_ptr(intrusive_ptr<U> other) MVCC11_NOEXCEPT(true);
+
+  ~intrusive_ptr();
+
+  intrusive_ptr& operator=(intrusive_ptr other) MVCC11_NOEXCEPT(true);
+
+  template <class... Args>
+  static intrusive_ptr make(Args&&... args);
+
+  T* get() const MVCC11_NOEXCEPT(true);
+  T& operator*() const MVCC11_NOEXCEPT(true);
+  T* operator->() const MVCC11_NOEXCEPT(true);
+
+  explicit operator bool() const MVCC11_NOEXCEPT(true);
+
+  std::uint32_t use_count() const MVCC11_NOEXCEPT(true);
+
+  friend bool operator==(intrusive_ptr const &lhs, intrusive_ptr const &rhs) MVCC11_NOEXCEPT(true)
+  {
+    return lhs.node_ == rhs.node_;
+  }
+  friend bool operator!=(intrusive_ptr const &lhs, intrusive_ptr const &rhs) MVCC11_NOEXCEPT(true)
+  {
+    return lhs.node_ != rhs.node_;
+  }
+
+private:
+  template <class>
+  friend class intrusive_ptr;
+  template <class>
+  friend class atomic_intrusive_ptr;
+
+  using node_type = detail::intrusive_node<typename std::remove_const<T>::type>;
+
+  // Adopts a reference already taken on `node`.
+  explicit intrusive_ptr(node_type *node) MVCC11_NOEXCEPT(true);
+
+  node_type* release() MVCC11_NOEXCEPT(true);
+
+  static void add_ref(node_type *node) MVCC11_NOEXCEPT(true);
+  static void drop_ref(node_type *node) MVCC11_NOEXCEPT(true);
+
+  node_type *node_;
+};
+
+// An intrusive_ptr that can be loaded, stored and CASed concurrently, all
+// of it lock-free.
+//
+// Loading has to take a reference before the pointee can be freed by a
+// concurrent store. So a load first pins the node by bumping a count kept in
+// the upper 16 bits of the pointer word, takes its reference, then unpins.
+// A store or CAS that swaps the node out moves the pins still counted in the
+// word onto the node's own count, which the pinning loads then drop (split
+// reference counting). Node addresses must fit in 48 bits, which is the case
+// for user space on x86-64 and AArch64 Linux.
+//
+// Readers still write to the pointer word, so loads of a hot pointer from
+// many cores contend on its cache line, though nobody ever waits for a
+// preempted lock holder.
+template <class T>
+class atomic_intrusive_ptr
+{
+public:
+  atomic_intrusive_ptr(intrusive_ptr<T> desired) MVCC11_NOEXCEPT(true);
+
+  atomic_intrusive_ptr(atomic_intrusive_ptr const &other) = delete;
+  atomic_intrusive_ptr& operator=(atomic_intrusive_ptr const &other) = delete;
+
+  ~atomic_intrusive_ptr();
+
+  intrusive_ptr<T> load() const MVCC11_NOEXCEPT(true);
+  void store(intrusive_ptr<T> desired) MVCC11_NOEXCEPT(true);
+  bool compare_exchange_strong(intrusive_ptr<T> &expected, intrusive_ptr<T> desired) MVCC11_NOEXCEPT(true);
+
+private:
+  using node_type = typename intrusive_ptr<T>::node_type;
+
+  static std::uint64_t const PIN = std::uint64_t{1} << 48;
+
+  static std::uint64_t to_word(node_type *node) MVCC11_NOEXCEPT(true);
+  static node_type* to_node(std::uint64_t word) MVCC11_NOEXCEPT(true);
+
+  static void retire(std::uint64_t word) MVCC11_NOEXCEPT(true);
+  void unpin(node_type *node, std::uint64_t pinned) const MVCC11_NOEXCEPT(true);
+
+  // The node's address in the lower 48 bits, and the number of loads that
+  // have it pinned in the upper 16.
+  mutable std::atomic<std::uint64_t> word_;
+};
+
+// Snapshots held by intrusive_ptr: one allocation per snapshot and 32-bit
+// reference counts.
+struct intrusive_ptr_policy
+{
+  template <class T>
+  using pointer = intrusive_ptr<T>;
+
+  template <class T>
+  using atomic_pointer = atomic_intrusive_ptr<T>;
+
+  template <class T, class... Args>
+  static pointer<T> make(Args&&... args)
+  {
+    return intrusive_ptr<T>::make(std::forward<Args>(args)...);
+  }
+
+  template <class T>
+  static pointer<T> load(atomic_pointer<T> const &p) MVCC11_NOEXCEPT(true)
+  {
+    return p.load();
+  }
+
+  template <class T>
+  static void store(atomic_pointer<T> &p, pointer<T> desired) MVCC11_NOEXCEPT(true)
+  {
+    p.store(std::move(desired));
+  }
+
+  template <class T>
+  static bool compare_exchange_strong(atomic_pointer<T> &p, pointer<T> &expected, pointer<T> desired) MVCC11_NOEXCEPT(true)
+  {
+    return p.compare_exchange_strong(expected, std::move(desired));
+  }
+};
+
+template <class T>
+intrusive_ptr<T>::intrusive_ptr() MVCC11_NOEXCEPT(true)
+: node_{nullptr}
+{}
+template <class T>
+intrusive_ptr<T>::intrusive_ptr(std::nullptr_t) MVCC11_NOEXCEPT(true)
+: node_{nullptr}
+{}
+template <class T>
+intrusive_ptr<T>::intrusive_ptr(node_type *node) MVCC11_NOEXCEPT(true)
+: node_{node}
+{}
+template <class T>
+intrusive_ptr<T>::intrusive_ptr(intrusive_ptr const &other) MVCC11_NOEXCEPT(true)
+: node_{other.node_}
+{
+  add_ref(node_);
+}
+template <class T>
+intrusive_ptr<T>::intrusive_ptr(intrusive_ptr &&other) MVCC11_NOEXCEPT(true)
+: node_{other.release()}
+{}
+template <class T>
+template <class U, class>
+intrusive_ptr<T>::intrusive_ptr(intrusive_ptr<U> other) MVCC11_NOEXCEPT(true)
+: node_{other.release()}
+{}
+template <class T>
+intrusive_ptr<T>::~intrusive_ptr()
+{
+  drop_ref(node_);
+}
+
+template <class T>
+auto intrusive_ptr<T>::operator=(intrusive_ptr other) MVCC11_NOEXCEPT(true) -> intrusive_ptr &
+{
+  std::swap(node_, other.node_);
+
+  return *this;
+}
+
+template <class T>
+template <class... Args>
+auto intrusive_ptr<T>::make(Args&&... args) -> intrusive_ptr
+{
+  return intrusive_ptr{new node_type(std::forward<Args>(args)...)};
+}
+
+template <class T>
+T* intrusive_ptr<T>::get() const MVCC11_NOEXCEPT(true)
+{
+  return node_ != nullptr ? &node_->value : nullptr;
+}
+template <class T>
+T& intrusive_ptr<T>::operator*() const MVCC11_NOEXCEPT(true)
+{
+  return node_->value;
+}
+template <class T>
+T* intrusive_ptr<T>::operator->() const MVCC11_NOEXCEPT(true)
+{
+  return &node_->value;
+}
+template <class T>
+intrusive_ptr<T>::operator bool() const MVCC11_NOEXCEPT(true)
+{
+  return node_ != nullptr;
+}
+template <class T>
+std::uint32_t intrusive_ptr<T>::use_count() const MVCC11_NOEXCEPT(true)
+{
+  return node_ != nullptr ? node_->refs.load(std::memory_order_relaxed) : 0;
+}
+
+template <class T>
+auto intrusive_ptr<T>::release() MVCC11_NOEXCEPT(true) -> node_type *
+{
+  auto node = node_;
+  node_ = nullptr;
+  return node;
+}
+
+template <class T>
+void intrusive_ptr<T>::add_ref(node_type *node) MVCC11_NOEXCEPT(true)
+{
+  if(node != nullptr)
+    node->refs.fetch_add(1, std::memory_order_relaxed);
+}
+template <class T>
+void intrusive_ptr<T>::drop_ref(node_type *node) MVCC11_NOEXCEPT(true)
+{
+  if(node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    delete node;
+}
+
+
+template <class T>
+atomic_intrusive_ptr<T>::atomic_intrusive_ptr(intrusive_ptr<T> desired) MVCC11_NOEXCEPT(true)
+: word_{to_word(desired.release())}
+{}
+template <class T>
+atomic_intrusive_ptr<T>::~atomic_intrusive_ptr()
+{
+  retire(word_.load(std::memory_order_acquire));
+}
+
+template <class T>
+intrusive_ptr<T> atomic_intrusive_ptr<T>::load() const MVCC11_NOEXCEPT(true)
+{
+  auto const pinned = word_.fetch_add(PIN, std::memory_order_acquire) + PIN;
+  auto const node = to_node(pinned);
+  intrusive_ptr<T>::add_ref(node);
+  this->unpin(node, pinned);
+
+  return intrusive_ptr<T>{node};
+}
+
+template <class T>
+void atomic_intrusive_ptr<T>::store(intrusive_ptr<T> desired) MVCC11_NOEXCEPT(true)
+{
+  retire(word_.exchange(to_word(desired.release()), std::memory_order_acq_rel));
+}
+
+// On failure, `expected` is replaced by a fresh load(), since the node seen
+// in the word may be freed as soon as it is swapped out.
+template <class T>
+bool atomic_intrusive_ptr<T>::compare_exchange_strong(intrusive_ptr<T> &expected, intrusive_ptr<T> desired) MVCC11_NOEXCEPT(true)
+{
+  auto word = word_.load(std::memory_order_acquire);
+  while(to_node(word) == expected.node_)
+  {
+    // Only the pin count may have changed when this fails.
+    auto const exchanged =
+      word_.compare_exchange_weak(
+        word,
+        to_word(desired.node_),
+        std::memory_order_acq_rel,
+        std::memory_order_acquire);
+
+    if(exchanged)
+    {
+      desired.release();
+      retire(word);
+      return true;
+    }
+  }
+
+  expected = this->load();
+  return false;
+}
+
+template <class T>
+std::uint64_t atomic_intrusive_ptr<T>::to_word(node_type *node) MVCC11_NOEXCEPT(true)
+{
+  auto const word = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(node));
+  assert(word < PIN);
+  return word;
+}
+template <class T>
+auto atomic_intrusive_ptr<T>::to_node(std::uint64_t word) MVCC11_NOEXCEPT(true) -> node_type *
+{
+  return reinterpret_cast<node_type *>(static_cast<std::uintptr_t>(word & (PIN - 1)));
+}
+
+// Releases the reference a swapped out word held, after moving the pins
+// still counted in it onto the node. The node cannot have been freed in
+// the meantime, as that reference was still there.
+template <class T>
+void atomic_intrusive_ptr<T>::retire(std::uint64_t word) MVCC11_NOEXCEPT(true)
+{
+  auto const node = to_node(word);
+  auto const pins = static_cast<std::uint32_t>(word / PIN);
+
+  if(node != nullptr && pins != 0)
+    node->refs.fetch_add(pins, std::memory_order_relaxed);
+
+  intrusive_ptr<T>::drop_ref(node);
+}
+
+// Drops the pin a load() took on `node`. While the node is still in the
+// word, that is taking one off the word's count; once it has been swapped
+// out, the pin lives on as a reference of the node.
+//
+// The node may have been swapped out and stored again since, so the pins in
+// the word are not necessarily of the same store as ours. That is fine, as
+// pins are interchangeable: if we take another load's pin off the word, ours
+// was moved onto the node, and that load will find one pin short in the word
+// and drop the reference ours became instead. What must not happen is taking
+// a pin off a word that has none left.
+template <class T>
+void atomic_intrusive_ptr<T>::unpin(node_type *node, std::uint64_t pinned) const MVCC11_NOEXCEPT(true)
+{
+  auto expected = pinned;
+  while(to_node(expected) == node && expected >= PIN)
+  {
+    auto const unpinned =
+      word_.compare_exchange_weak(
+        expected,
+        expected - PIN,
+        std::memory_order_release,
+        std::memory_order_relaxed);
+
+    if(unpinned)
+      return;
+  }
+
+  intrusive_ptr<T>::drop_ref(node);
+}
+
+} // namespace mvcc11
+
+#endif // MVCC11_INTRUSIVE_PTR_POLICY_HPP
@@ -20,59 +20,321 @@
 #define MVCC11_CONTENSION_BACKOFF_SLEEP_MS 50
 #endif // MVCC11_CONTENSION_BACKOFF_SLEEP_MS
 
-// Optionally uses std::shared_ptr instead of boost::shared_ptr
+// Number of failed optimistic attempts update() makes before it takes the
+// starvation ticket and makes other writers defer to it.
+#ifndef MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS
+#define MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS 4
+#endif // MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS
+
+// Least time a writer defers to each attempt of a starving updater before
+// going ahead anyway. Attempts that were seen to take longer get twice as
+// long as the slowest of them.
+#ifndef MVCC11_STARVATION_DEFER_MAX_MS
+#define MVCC11_STARVATION_DEFER_MAX_MS 500
+#endif // MVCC11_STARVATION_DEFER_MAX_MS
+
+#include <mvcc11/config.hpp>
+
+// Optionally uses std::shared_ptr instead of boost::shared_ptr by default
 #ifdef MVCC11_USES_STD_SHARED_PTR
 
-#include <memory>
+#include <mvcc11/std_shared_ptr_policy.hpp>
 
 namespace mvcc11 {
-namespace smart_ptr {
 
-using std::shared_ptr;
-using std::make_shared;
-using std::atomic_load;
-using std::atomic_store;
-using std::atomic_compare_exchange_strong
+using default_pointer_policy = std_shared_ptr_policy;
 
-} // namespace smart_ptr
 } // namespace mvcc11
 
 #else // MVCC11_USES_STD_SHARED_PTR
 
-#include <boost/smart_ptr/shared_ptr.hpp>
-#include <boost/smart_ptr/make_shared.hpp>
+#include <mvcc11/boost_shared_ptr_policy.hpp>
 
 namespace mvcc11 {
-namespace smart_ptr {
-
-using boost::shared_ptr;
-using boost::make_shared;
-using boost::atomic_load;
-using boost::atomic_store;
 
-template <class T>
-bool atomic_compare_exchange_strong(shared_ptr<T> * p, shared_ptr<T> * v, shared_ptr<T> w)
-{
-  return boost::atomic_compare_exchange(p, v, w);
-}
+using default_pointer_policy = boost_shared_ptr_policy;
 
-} // namespace smart_ptr
 } // namespace mvcc11
 
 #endif // MVCC11_USES_STD_SHARED_PTR
 
 #include <utility>
+#include <algorithm>
 #include <chrono>
 #include <thread>
-
-#ifdef MVCC11_DISABLE_NOEXCEPT
-#define MVCC11_NOEXCEPT(COND)
-#else
-#define MVCC11_NOEXCEPT(COND) noexcept(COND)
-#endif
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <type_traits>
 
 namespace mvcc11 {
 
+namespace detail {
+
+// Updaters of one mvcc that ran out of optimistic attempts. They take turns
+// running, and while any of them holds a ticket, other writers defer to it.
+//
+// Waits are bounded by a deadline that the thread whose turn it is restarts
+// before each of its attempts: MVCC11_STARVATION_DEFER_MAX_MS, or twice its
+// slowest attempt so far if that is longer. An attempt that runs no slower
+// than the ones before it is therefore never raced, however slow it is. One
+// that waits on another thread which has to publish first only delays that
+// thread until the deadline, instead of deadlocking with it. Writes made
+// from the thread whose turn it is, i.e. from inside the running updater,
+// never defer to their own ticket.
+class starvation_queue
+{
+public:
+  starvation_queue() MVCC11_NOEXCEPT(true)
+  : holders_{0}
+  , turn_depth_{0}
+  {}
+
+  starvation_queue(starvation_queue const &) = delete;
+  starvation_queue& operator=(starvation_queue const &) = delete;
+
+  // Takes a ticket and waits for the turn; returns whether it got it.
+  bool enter();
+  void leave(bool had_turn);
+
+  // Restarts the deadline of the calling thread's turn, if it has one, given
+  // how long its slowest attempt so far took.
+  void begin_attempt(std::chrono::steady_clock::duration slowest);
+
+  // Whether a ticket is held and it is not the calling thread's turn.
+  bool has_others();
+  void wait_for_others();
+
+private:
+  // Waits until `done` holds, or the deadline of the current turn (or of the
+  // wait itself, between turns) passes. Returns done().
+  template <class Predicate>
+  bool wait_for_turn(std::unique_lock<std::mutex> &lock, Predicate done);
+
+  std::atomic<size_t> holders_;
+  std::mutex mutex_;
+  std::condition_variable released_;
+  std::thread::id turn_owner_;
+  size_t turn_depth_;
+  std::chrono::steady_clock::time_point turn_deadline_;
+};
+
+template <class Predicate>
+bool starvation_queue::wait_for_turn(std::unique_lock<std::mutex> &lock, Predicate done)
+{
+  auto const idle_deadline =
+    std::chrono::steady_clock::now() + std::chrono::milliseconds(MVCC11_STARVATION_DEFER_MAX_MS);
+
+  while(!done())
+  {
+    // Re-read on every wake up, as the turn holder may have restarted it.
+    auto const deadline = turn_depth_ != 0 ? turn_deadline_ : idle_deadline;
+    if(std::chrono::steady_clock::now() >= deadline)
+      return false;
+
+    released_.wait_until(lock, deadline);
+  }
+
+  return true;
+}
+
+inline bool starvation_queue::enter()
+{
+  std::unique_lock<std::mutex> lock{mutex_};
+  ++holders_;
+
+  auto const self = std::this_thread::get_id();
+  auto const has_turn =
+    this->wait_for_turn(lock, [&] {
+        return turn_depth_ == 0 || turn_owner_ == self;
+      });
+
+  if(has_turn)
+  {
+    if(turn_depth_++ == 0)
+      turn_deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(MVCC11_STARVATION_DEFER_MAX_MS);
+    turn_owner_ = self;
+  }
+
+  return has_turn;
+}
+
+inline void starvation_queue::begin_attempt(std::chrono::steady_clock::duration slowest)
+{
+  std::chrono::steady_clock::duration const least =
+    std::chrono::milliseconds(MVCC11_STARVATION_DEFER_MAX_MS);
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  if(turn_depth_ != 0 && turn_owner_ == std::this_thread::get_id())
+    turn_deadline_ = std::chrono::steady_clock::now() + std::max(least, 2 * slowest);
+}
+
+inline void starvation_queue::leave(bool had_turn)
+{
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    --holders_;
+    if(had_turn && --turn_depth_ == 0)
+      turn_owner_ = std::thread::id{};
+  }
+  released_.notify_all();
+}
+
+inline bool starvation_queue::has_others()
+{
+  if(holders_.load() == 0)
+    return false;
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  return holders_.load() != 0 && turn_owner_ != std::this_thread::get_id();
+}
+
+inline void starvation_queue::wait_for_others()
+{
+  if(holders_.load() == 0)
+    return;
+
+  std::unique_lock<std::mutex> lock{mutex_};
+  auto const self = std::this_thread::get_id();
+  this->wait_for_turn(lock, [&] {
+      return holders_.load() == 0 || turn_owner_ == self;
+    });
+}
+
+// Holds a starvation ticket for the lifetime of a scope, so an updater that
+// throws still lets other writers go.
+class starvation_ticket
+{
+public:
+  starvation_ticket(starvation_queue &queue)
+  : queue_(queue)
+  , has_turn_{queue.enter()}
+  {}
+  ~starvation_ticket()
+  {
+    queue_.leave(has_turn_);
+  }
+
+  starvation_ticket(starvation_ticket const &) = delete;
+  starvation_ticket& operator=(starvation_ticket const &) = delete;
+
+private:
+  starvation_queue &queue_;
+  bool const has_turn_;
+};
+
+// Unique address per type, used as a key.
+template <class T>
+struct type_key
+{
+  static char const id;
+};
+template <class T>
+char const type_key<T>::id = 0;
+
+// Lazily computed views of a snapshot, in a lock-free list keyed by the type
+// of their derivation (which snapshot::derived() requires to be stateless).
+// Each view is computed once, guarded by its own once_flag. Copies of a
+// snapshot start out without views.
+class derived_views
+{
+public:
+  derived_views() MVCC11_NOEXCEPT(true)
+  : head_{nullptr}
+  {}
+  derived_views(derived_views const &) MVCC11_NOEXCEPT(true)
+  : head_{nullptr}
+  {}
+  derived_views& operator=(derived_views const &) MVCC11_NOEXCEPT(true)
+  {
+    return *this;
+  }
+  ~derived_views()
+  {
+    auto view = head_.load(std::memory_order_acquire);
+    while(view != nullptr)
+    {
+      auto next = view->next;
+      delete view;
+      view = next;
+    }
+  }
+
+  template <class Result, class Compute>
+  Result const& get(void const *key, Compute &compute);
+
+private:
+  struct view_base
+  {
+    view_base(void const *k) MVCC11_NOEXCEPT(true)
+    : key{k}
+    , next{nullptr}
+    {}
+    virtual ~view_base() {}
+
+    void const *key;
+    view_base *next;
+    std::once_flag once;
+  };
+
+  template <class Result>
+  struct view : view_base
+  {
+    view(void const *k) MVCC11_NOEXCEPT(true)
+    : view_base{k}
+    {}
+
+    std::unique_ptr<Result const> result;
+  };
+
+  static view_base* find(view_base *view, void const *key) MVCC11_NOEXCEPT(true)
+  {
+    while(view != nullptr && view->key != key)
+      view = view->next;
+    return view;
+  }
+
+  std::atomic<view_base *> head_;
+};
+
+// Finds the view for `key`, adding it if it is not there yet, then computes
+// it unless some other reader already did. Two readers may race to add the
+// same view; the loser throws its node away before computing anything.
+template <class Result, class Compute>
+Result const& derived_views::get(void const *key, Compute &compute)
+{
+  auto head = head_.load(std::memory_order_acquire);
+  auto found = find(head, key);
+
+  if(found == nullptr)
+  {
+    std::unique_ptr<view_base> fresh{new view<Result>{key}};
+    while(true)
+    {
+      fresh->next = head;
+      if(head_.compare_exchange_weak(head, fresh.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+      {
+        found = fresh.release();
+        break;
+      }
+
+      found = find(head, key);
+      if(found != nullptr)
+        break;
+    }
+  }
+
+  auto &v = static_cast<view<Result> &>(*found);
+  std::call_once(v.once, [&] {
+      v.result.reset(new Result(compute()));
+    });
+
+  return *v.result;
+}
+
+} // namespace detail
+
 template <class ValueType>
 struct snapshot
 {
@@ -84,18 +346,36 @@ struct snapshot
   snapshot(size_t ver, U&& arg)
     MVCC11_NOEXCEPT( MVCC11_NOEXCEPT(value_type{std::forward<U>(arg)}) );
 
+  // Returns `derivation(version, value)`, computed by the first caller and
+  // shared by every later one until the snapshot goes away. Views are keyed
+  // by the type of `derivation`, so it must be a stateless function object
+  // such as a captureless lambda; function pointers and std::function
+  // would make different derivations share a view.
+  //
+  // The result lives inside the snapshot, so hold the snapshot pointer for
+  // as long as the result is used.
+  template <class Derivation>
+  auto derived(Derivation derivation) const
+    -> typename std::decay<decltype(derivation(size_t{}, std::declval<value_type const &>()))>::type const &;
+
   size_t version;
   value_type value;
+
+private:
+  mutable detail::derived_views views_;
 };
 
-template <class ValueType>
+// PointerPolicy decides how snapshots are allocated, held and published
+// atomically; see boost_shared_ptr_policy for the interface it provides.
+template <class ValueType, class PointerPolicy = default_pointer_policy>
 class mvcc
 {
 public:
   using value_type = ValueType;
+  using pointer_policy = PointerPolicy;
   using snapshot_type = snapshot<value_type>;
-  using mutable_snapshot_ptr = smart_ptr::shared_ptr<snapshot_type>;
-  using const_snapshot_ptr = smart_ptr::shared_ptr<snapshot_type const>;
+  using mutable_snapshot_ptr = typename pointer_policy::template pointer<snapshot_type>;
+  using const_snapshot_ptr = typename pointer_policy::template pointer<snapshot_type const>;
 
   mvcc() MVCC11_NOEXCEPT(true);
 
@@ -145,7 +425,12 @@ private:
     Updater &updater,
     std::chrono::time_point<Clock, Duration> const &timeout_time);
 
-  mutable_snapshot_ptr mutable_current_;
+  template <class Updater>
+  const_snapshot_ptr update_starving_impl(Updater &updater, std::chrono::steady_clock::duration slowest);
+
+  typename pointer_policy::template atomic_pointer<snapshot_type> mutable_current_;
+
+  detail::starvation_queue starving_updaters_;
 };
 
 template <class ValueType>
@@ -162,94 +447,114 @@ snapshot<ValueType>::snapshot(size_t ver, U&& arg)
 , value{std::forward<U>(arg)}
 {}
 
-
 template <class ValueType>
-mvcc<ValueType>::mvcc() MVCC11_NOEXCEPT(true)
-: mutable_current_{smart_ptr::make_shared<snapshot_type>(0)}
+template <class Derivation>
+auto snapshot<ValueType>::derived(Derivation derivation) const
+  -> typename std::decay<decltype(derivation(size_t{}, std::declval<value_type const &>()))>::type const &
+{
+  static_assert(std::is_empty<Derivation>::value && !std::is_pointer<Derivation>::value,
+                "snapshot::derived() requires a stateless function object, as views are keyed by its type");
+
+  using result_type =
+    typename std::decay<decltype(derivation(size_t{}, std::declval<value_type const &>()))>::type;
+
+  auto compute = [&] {
+      return derivation(version, value);
+    };
+
+  return views_.template get<result_type>(&detail::type_key<Derivation>::id, compute);
+}
+
+
+template <class ValueType, class PointerPolicy>
+mvcc<ValueType, PointerPolicy>::mvcc() MVCC11_NOEXCEPT(true)
+: mutable_current_{pointer_policy::template make<snapshot_type>(0)}
 {}
-template <class ValueType>
-mvcc<ValueType>::mvcc(value_type const &value)
-: mutable_current_{smart_ptr::make_shared<snapshot_type>(0, value)}
+template <class ValueType, class PointerPolicy>
+mvcc<ValueType, PointerPolicy>::mvcc(value_type const &value)
+: mutable_current_{pointer_policy::template make<snapshot_type>(0, value)}
 {
 }
-template <class ValueType>
-mvcc<ValueType>::mvcc(value_type &&value)
-: mutable_current_{smart_ptr::make_shared<snapshot_type>(0, std::move(value))}
+template <class ValueType, class PointerPolicy>
+mvcc<ValueType, PointerPolicy>::mvcc(value_type &&value)
+: mutable_current_{pointer_policy::template make<snapshot_type>(0, std::move(value))}
 {
 }
-template <class ValueType>
-mvcc<ValueType>::mvcc(mvcc const &other) MVCC11_NOEXCEPT(true)
-: mutable_current_{smart_ptr::atomic_load(other)}
+template <class ValueType, class PointerPolicy>
+mvcc<ValueType, PointerPolicy>::mvcc(mvcc const &other) MVCC11_NOEXCEPT(true)
+: mutable_current_{pointer_policy::load(other.mutable_current_)}
 {
 }
-template <class ValueType>
-mvcc<ValueType>::mvcc(mvcc &&other) MVCC11_NOEXCEPT(true)
-: mutable_current_{smart_ptr::atomic_load(other)}
+template <class ValueType, class PointerPolicy>
+mvcc<ValueType, PointerPolicy>::mvcc(mvcc &&other) MVCC11_NOEXCEPT(true)
+: mutable_current_{pointer_policy::load(other.mutable_current_)}
 {
 }
 
-template <class ValueType>
-auto mvcc<ValueType>::operator=(mvcc const &other) MVCC11_NOEXCEPT(true) -> mvcc &
+template <class ValueType, class PointerPolicy>
+auto mvcc<ValueType, PointerPolicy>::operator=(mvcc const &other) MVCC11_NOEXCEPT(true) -> mvcc &
 {
-  smart_ptr::atomic_store(&this->mutable_current_,
-                          smart_ptr::atomic_load(&other.mutable_current_));
+  pointer_policy::store(this->mutable_current_,
+                        pointer_policy::load(other.mutable_current_));
 
   return *this;
 }
-template <class ValueType>
-auto mvcc<ValueType>::operator=(mvcc &&other) MVCC11_NOEXCEPT(true) -> mvcc &
+template <class ValueType, class PointerPolicy>
+auto mvcc<ValueType, PointerPolicy>::operator=(mvcc &&other) MVCC11_NOEXCEPT(true) -> mvcc &
 {
-  smart_ptr::atomic_store(&this->mutable_current_,
-                          smart_ptr::atomic_load(&other.mutable_current_));
+  pointer_policy::store(this->mutable_current_,
+                        pointer_policy::load(other.mutable_current_));
 
   return *this;
 }
 
-template <class ValueType>
-auto mvcc<ValueType>::current() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+template <class ValueType, class PointerPolicy>
+auto mvcc<ValueType, PointerPolicy>::current() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
 {
-  return smart_ptr::atomic_load(&mutable_current_);
+  return pointer_policy::load(mutable_current_);
 }
-template <class ValueType>
-auto mvcc<ValueType>::operator*() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+template <class ValueType, class PointerPolicy>
+auto mvcc<ValueType, PointerPolicy>::operator*() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
 {
   return this->current();
 }
-template <class ValueType>
-auto mvcc<ValueType>::operator->() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+template <class ValueType, class PointerPolicy>
+auto mvcc<ValueType, PointerPolicy>::operator->() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
 {
   return this->current();
 }
 
-template <class ValueType>
-auto mvcc<ValueType>::overwrite(value_type const &value) -> const_snapshot_ptr
+template <class ValueType, class PointerPolicy>
+auto mvcc<ValueType, PointerPolicy>::overwrite(value_type const &value) -> const_snapshot_ptr
 {
   return this->overwrite_impl(value);
 }
-template <class ValueType>
-auto mvcc<ValueType>::overwrite(value_type &&value) -> const_snapshot_ptr
+template <class ValueType, class PointerPolicy>
+auto mvcc<ValueType, PointerPolicy>::overwrite(value_type &&value) -> const_snapshot_ptr
 {
   return this->overwrite_impl(std::move(value));
 }
 
-template <class ValueType>
+template <class ValueType, class PointerPolicy>
 template <class U>
-auto mvcc<ValueType>::overwrite_impl(U &&value) -> const_snapshot_ptr
+auto mvcc<ValueType, PointerPolicy>::overwrite_impl(U &&value) -> const_snapshot_ptr
 {
   auto desired =
-    smart_ptr::make_shared<snapshot_type>(
+    pointer_policy::template make<snapshot_type>(
       0,
       std::forward<U>(value));
 
   while(true)
   {
-    auto expected = smart_ptr::atomic_load(&mutable_current_);
+    starving_updaters_.wait_for_others();
+
+    auto expected = pointer_policy::load(mutable_current_);
     desired->version = expected->version + 1;
 
     auto const overwritten =
-      smart_ptr::atomic_compare_exchange_strong(
-        &mutable_current_,
-        &expected,
+      pointer_policy::compare_exchange_strong(
+        mutable_current_,
+        expected,
         desired);
 
     if(overwritten)
@@ -257,30 +562,46 @@ auto mvcc<ValueType>::overwrite_impl(U &&value) -> const_snapshot_ptr
   }
 }
 
-template <class ValueType>
+template <class ValueType, class PointerPolicy>
 template <class Updater>
-auto mvcc<ValueType>::update(Updater updater) -> const_snapshot_ptr
+auto mvcc<ValueType, PointerPolicy>::update(Updater updater) -> const_snapshot_ptr
 {
-  while(true)
+  // How long the updater runs is only of interest once it is contended, so
+  // the first attempt goes untimed.
+  auto slowest = std::chrono::steady_clock::duration::zero();
+  auto started = std::chrono::steady_clock::time_point{};
+
+  for(size_t attempt = 0; attempt < MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS; ++attempt)
   {
+    starving_updaters_.wait_for_others();
+
+    if(attempt != 0)
+      started = std::chrono::steady_clock::now();
     auto updated = this->try_update_impl(updater);
     if(updated != nullptr)
       return updated;
+    if(attempt != 0)
+      slowest = std::max(slowest, std::chrono::steady_clock::now() - started);
 
     std::this_thread::sleep_for(std::chrono::milliseconds(MVCC11_CONTENSION_BACKOFF_SLEEP_MS));
   }
+
+  return this->update_starving_impl(updater, slowest);
 }
 
-template <class ValueType>
+template <class ValueType, class PointerPolicy>
 template <class Updater>
-auto mvcc<ValueType>::try_update(Updater updater) -> const_snapshot_ptr
+auto mvcc<ValueType, PointerPolicy>::try_update(Updater updater) -> const_snapshot_ptr
 {
+  if(starving_updaters_.has_others())
+    return nullptr;
+
   return this->try_update_impl(updater);
 }
 
-template <class ValueType>
+template <class ValueType, class PointerPolicy>
 template <class Updater, class Clock, class Duration>
-auto mvcc<ValueType>::try_update_until(
+auto mvcc<ValueType, PointerPolicy>::try_update_until(
   Updater updater,
   std::chrono::time_point<Clock, Duration> const &timeout_time)
   -> const_snapshot_ptr
@@ -288,9 +609,9 @@ auto mvcc<ValueType>::try_update_until(
   return this->try_update_until_impl(updater, timeout_time);
 }
 
-template <class ValueType>
+template <class ValueType, class PointerPolicy>
 template <class Updater, class Rep, class Period>
-auto mvcc<ValueType>::try_update_for(
+auto mvcc<ValueType, PointerPolicy>::try_update_for(
   Updater updater,
   std::chrono::duration<Rep, Period> const &timeout_duration)
   -> const_snapshot_ptr
@@ -300,23 +621,23 @@ auto mvcc<ValueType>::try_update_for(
 }
 
 
-template <class ValueType>
+template <class ValueType, class PointerPolicy>
 template <class Updater>
-auto mvcc<ValueType>::try_update_impl(Updater &updater) -> const_snapshot_ptr
+auto mvcc<ValueType, PointerPolicy>::try_update_impl(Updater &updater) -> const_snapshot_ptr
 {
-  auto expected = smart_ptr::atomic_load(&mutable_current_);
+  auto expected = pointer_policy::load(mutable_current_);
   auto const const_expected_version = expected->version;
   auto const &const_expected_value = expected->value;
 
   auto desired =
-    smart_ptr::make_shared<snapshot_type>(
+    pointer_policy::template make<snapshot_type>(
       const_expected_version + 1,
       updater(const_expected_version, const_expected_value));
 
   auto const updated =
-    smart_ptr::atomic_compare_exchange_strong(
-      &mutable_current_,
-      &expected,
+    pointer_policy::compare_exchange_strong(
+      mutable_current_,
+      expected,
       desired);
 
   if(updated)
@@ -324,19 +645,22 @@ auto mvcc<ValueType>::try_update_impl(Updater &updater) -> const_snapshot_ptr
 
   return nullptr;
 }
-template <class ValueType>
+template <class ValueType, class PointerPolicy>
 template <class Updater, class Clock, class Duration>
-auto mvcc<ValueType>::try_update_until_impl(
+auto mvcc<ValueType, PointerPolicy>::try_update_until_impl(
   Updater &updater,
   std::chrono::time_point<Clock, Duration> const &timeout_time)
   -> const_snapshot_ptr
 {
   while(true)
   {
-    auto updated = this->try_update_impl(updater);
+    if(!starving_updaters_.has_others())
+    {
+      auto updated = this->try_update_impl(updater);
 
-    if(updated != nullptr)
-      return updated;
+      if(updated != nullptr)
+        return updated;
+    }
 
     if(std::chrono::high_resolution_clock::now() > timeout_time)
       return nullptr;
@@ -345,6 +669,32 @@ auto mvcc<ValueType>::try_update_until_impl(
   }
 }
 
+// Pessimistic fallback of update(). Starving updaters take turns, and other
+// writers back off while any of them holds a ticket. The only commits that
+// can still beat us are those already past their wait_for_others() check,
+// those the updater makes itself, and those whose wait outlasted an attempt
+// much slower than the ones before it, so retries are few. The updater may
+// write to (even update()) this mvcc.
+template <class ValueType, class PointerPolicy>
+template <class Updater>
+auto mvcc<ValueType, PointerPolicy>::update_starving_impl(Updater &updater, std::chrono::steady_clock::duration slowest) -> const_snapshot_ptr
+{
+  detail::starvation_ticket ticket{starving_updaters_};
+
+  while(true)
+  {
+    starving_updaters_.begin_attempt(slowest);
+
+    auto const started = std::chrono::steady_clock::now();
+    auto updated = this->try_update_impl(updater);
+    if(updated != nullptr)
+      return updated;
+
+    slowest = std::max(slowest, std::chrono::steady_clock::now() - started);
+    std::this_thread::yield();
+  }
+}
+
 } // namespace mvcc11
 
 #endif // MVCC11_MVCC_HPP
@@ -0,0 +1,501 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+#ifndef MVCC11_REPLICATED_MVCC_HPP
+#define MVCC11_REPLICATED_MVCC_HPP
+
+#include <mvcc11/mvcc.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <new>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace mvcc11 {
+
+// Groups of `cores_per_replica` consecutive CPUs share one replica of the
+// current pointer. Set it to the number of cores per socket to get one
+// replica per NUMA node (assuming the usual consecutive CPU numbering).
+//
+// `replica_count` fixes the number of replicas instead of deriving it from
+// the number of CPUs, and `replica_of_cpu` replaces the grouping of CPUs
+// for other layouts. Its result is taken modulo the replica count.
+struct replication
+{
+  size_t cores_per_replica;
+  size_t replica_count;
+  size_t (*replica_of_cpu)(size_t cpu);
+};
+
+namespace detail {
+
+// Everything a replica's readers write to is allocated in whole blocks of
+// this many bytes, so that no two replicas ever share a cache line (nor a
+// pair of lines fetched together by the adjacent line prefetcher).
+size_t const REPLICA_BLOCK_SIZE = 128;
+
+inline void* replica_allocate(size_t size)
+{
+  auto const rounded = (size + REPLICA_BLOCK_SIZE - 1) / REPLICA_BLOCK_SIZE * REPLICA_BLOCK_SIZE;
+
+  void *block = nullptr;
+  if(::posix_memalign(&block, REPLICA_BLOCK_SIZE, rounded) != 0)
+    throw std::bad_alloc{};
+
+  return block;
+}
+
+inline void replica_deallocate(void *block) MVCC11_NOEXCEPT(true)
+{
+  ::free(block);
+}
+
+// Puts the control blocks of a replica's shared_ptrs in blocks of their own.
+template <class T>
+struct replica_allocator
+{
+  using value_type = T;
+
+  template <class U>
+  struct rebind
+  {
+    using other = replica_allocator<U>;
+  };
+
+  replica_allocator() MVCC11_NOEXCEPT(true) {}
+  template <class U>
+  replica_allocator(replica_allocator<U> const &) MVCC11_NOEXCEPT(true) {}
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T *>(replica_allocate(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t) MVCC11_NOEXCEPT(true)
+  {
+    replica_deallocate(p);
+  }
+
+  friend bool operator==(replica_allocator const &, replica_allocator const &) MVCC11_NOEXCEPT(true)
+  {
+    return true;
+  }
+  friend bool operator!=(replica_allocator const &, replica_allocator const &) MVCC11_NOEXCEPT(true)
+  {
+    return false;
+  }
+};
+
+} // namespace detail
+
+// An mvcc whose current pointer is replicated per core group.
+//
+// Writers go through an ordinary mvcc (so versions, update() and its
+// starvation fallback behave exactly the same), then fan the published
+// snapshot out to every replica before returning. current() reads the
+// replica of the calling CPU.
+//
+// Each replica points to a holder of its own reference to the snapshot,
+// and readers only ever write to the replica, its holder and that
+// reference's control block, all of which sit in blocks private to the
+// replica. current() is lock-free: a reader pins the holder by bumping a
+// count packed next to the holder's address in the replica, copies the
+// reference, then unpins. A publisher that swaps a holder out moves its
+// outstanding pins onto the holder, and whoever drops the last one frees
+// it (split reference counting). Holder addresses must fit in 48 bits,
+// which is the case for user space on x86-64 and AArch64 Linux.
+//
+// Replicas rely on shared_ptr's custom deleters, so replicated_mvcc always
+// uses default_pointer_policy.
+//
+// A replica never goes backwards in version, and once a publishing call
+// returns, every replica holds that version or a newer one. A reader that
+// migrates between core groups during a concurrent publish may briefly
+// observe an older version than it saw before.
+template <class ValueType>
+class replicated_mvcc
+{
+public:
+  using value_type = ValueType;
+  using snapshot_type = snapshot<value_type>;
+  using pointer_policy = default_pointer_policy;
+  using const_snapshot_ptr = typename mvcc<value_type, pointer_policy>::const_snapshot_ptr;
+
+  explicit replicated_mvcc(replication config);
+
+  replicated_mvcc(replication config, value_type const &value);
+  replicated_mvcc(replication config, value_type &&value);
+
+  replicated_mvcc(replicated_mvcc const &other) = delete;
+  replicated_mvcc& operator=(replicated_mvcc const &other) = delete;
+
+  ~replicated_mvcc();
+
+  size_t replica_count() const MVCC11_NOEXCEPT(true);
+
+  const_snapshot_ptr current() MVCC11_NOEXCEPT(true);
+  const_snapshot_ptr operator*() MVCC11_NOEXCEPT(true);
+  const_snapshot_ptr operator->() MVCC11_NOEXCEPT(true);
+
+  const_snapshot_ptr overwrite(value_type const &value);
+  const_snapshot_ptr overwrite(value_type &&value);
+
+  template <class Updater>
+  const_snapshot_ptr update(Updater updater);
+
+  template <class Updater>
+  const_snapshot_ptr try_update(Updater updater);
+
+  template <class Updater, class Clock, class Duration>
+  const_snapshot_ptr try_update_until(
+    Updater updater,
+    std::chrono::time_point<Clock, Duration> const &timeout_time);
+
+  template <class Updater, class Rep, class Period>
+  const_snapshot_ptr try_update_for(
+    Updater updater,
+    std::chrono::duration<Rep, Period> const &timeout_duration);
+
+private:
+  // Keeps the published snapshot alive for as long as a replica's own
+  // reference (and every copy handed out to readers) is alive.
+  struct replica_owner
+  {
+    void operator()(snapshot_type const *) MVCC11_NOEXCEPT(true)
+    {
+      published.reset();
+    }
+
+    const_snapshot_ptr published;
+  };
+
+  struct holder
+  {
+    explicit holder(const_snapshot_ptr const &published)
+    : snapshot{published.get(),
+               replica_owner{published},
+               detail::replica_allocator<snapshot_type>{}}
+    , detached_pins{0}
+    {}
+
+    const_snapshot_ptr snapshot;
+
+    // Pins moved here when the holder was swapped out, less the ones
+    // dropped since (or before, hence signed). Zero once all are gone.
+    std::atomic<std::int64_t> detached_pins;
+  };
+
+  // The current holder's address in the lower 48 bits, and the number of
+  // readers that have it pinned in the upper 16.
+  struct replica
+  {
+    std::atomic<std::uint64_t> word;
+    char padding[detail::REPLICA_BLOCK_SIZE - sizeof(std::atomic<std::uint64_t>)];
+  };
+
+  static std::uint64_t const PIN = std::uint64_t{1} << 48;
+
+  static holder* holder_of(std::uint64_t word) MVCC11_NOEXCEPT(true);
+  static std::int64_t pins_of(std::uint64_t word) MVCC11_NOEXCEPT(true);
+
+  static holder* make_holder(const_snapshot_ptr const &published);
+  static void destroy_holder(holder *h) MVCC11_NOEXCEPT(true);
+  static void retire(std::uint64_t word) MVCC11_NOEXCEPT(true);
+  static void unpin(replica &r, holder *h, std::uint64_t pinned) MVCC11_NOEXCEPT(true);
+
+  void init_replicas(replication config);
+  void destroy_replicas() MVCC11_NOEXCEPT(true);
+  const_snapshot_ptr publish(const_snapshot_ptr const &published);
+  replica& local_replica() MVCC11_NOEXCEPT(true);
+
+  mvcc<value_type, pointer_policy> master_;
+  size_t cores_per_replica_;
+  size_t (*replica_of_cpu_)(size_t cpu);
+  size_t replica_count_;
+  replica *replicas_;
+
+  // Serializes fanning out, so the holder a publisher finds in a replica
+  // cannot be freed while it compares versions.
+  std::mutex publish_mutex_;
+};
+
+template <class ValueType>
+replicated_mvcc<ValueType>::replicated_mvcc(replication config)
+: master_{}
+{
+  this->init_replicas(config);
+}
+template <class ValueType>
+replicated_mvcc<ValueType>::replicated_mvcc(replication config, value_type const &value)
+: master_{value}
+{
+  this->init_replicas(config);
+}
+template <class ValueType>
+replicated_mvcc<ValueType>::replicated_mvcc(replication config, value_type &&value)
+: master_{std::move(value)}
+{
+  this->init_replicas(config);
+}
+
+template <class ValueType>
+replicated_mvcc<ValueType>::~replicated_mvcc()
+{
+  this->destroy_replicas();
+}
+
+template <class ValueType>
+size_t replicated_mvcc<ValueType>::replica_count() const MVCC11_NOEXCEPT(true)
+{
+  return replica_count_;
+}
+
+template <class ValueType>
+auto replicated_mvcc<ValueType>::current() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  auto &r = this->local_replica();
+
+  auto const pinned = r.word.fetch_add(PIN, std::memory_order_acquire) + PIN;
+  auto const h = holder_of(pinned);
+  const_snapshot_ptr snapshot = h->snapshot;
+  unpin(r, h, pinned);
+
+  return snapshot;
+}
+template <class ValueType>
+auto replicated_mvcc<ValueType>::operator*() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  return this->current();
+}
+template <class ValueType>
+auto replicated_mvcc<ValueType>::operator->() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  return this->current();
+}
+
+template <class ValueType>
+auto replicated_mvcc<ValueType>::overwrite(value_type const &value) -> const_snapshot_ptr
+{
+  return this->publish(master_.overwrite(value));
+}
+template <class ValueType>
+auto replicated_mvcc<ValueType>::overwrite(value_type &&value) -> const_snapshot_ptr
+{
+  return this->publish(master_.overwrite(std::move(value)));
+}
+
+template <class ValueType>
+template <class Updater>
+auto replicated_mvcc<ValueType>::update(Updater updater) -> const_snapshot_ptr
+{
+  return this->publish(master_.update(updater));
+}
+
+template <class ValueType>
+template <class Updater>
+auto replicated_mvcc<ValueType>::try_update(Updater updater) -> const_snapshot_ptr
+{
+  return this->publish(master_.try_update(updater));
+}
+
+template <class ValueType>
+template <class Updater, class Clock, class Duration>
+auto replicated_mvcc<ValueType>::try_update_until(
+  Updater updater,
+  std::chrono::time_point<Clock, Duration> const &timeout_time)
+  -> const_snapshot_ptr
+{
+  return this->publish(master_.try_update_until(updater, timeout_time));
+}
+
+template <class ValueType>
+template <class Updater, class Rep, class Period>
+auto replicated_mvcc<ValueType>::try_update_for(
+  Updater updater,
+  std::chrono::duration<Rep, Period> const &timeout_duration)
+  -> const_snapshot_ptr
+{
+  return this->publish(master_.try_update_for(updater, timeout_duration));
+}
+
+template <class ValueType>
+auto replicated_mvcc<ValueType>::holder_of(std::uint64_t word) MVCC11_NOEXCEPT(true) -> holder *
+{
+  return reinterpret_cast<holder *>(static_cast<std::uintptr_t>(word & (PIN - 1)));
+}
+template <class ValueType>
+std::int64_t replicated_mvcc<ValueType>::pins_of(std::uint64_t word) MVCC11_NOEXCEPT(true)
+{
+  return static_cast<std::int64_t>(word / PIN);
+}
+
+template <class ValueType>
+auto replicated_mvcc<ValueType>::make_holder(const_snapshot_ptr const &published) -> holder *
+{
+  void *block = detail::replica_allocate(sizeof(holder));
+  try
+  {
+    auto const h = new (block) holder{published};
+    assert(reinterpret_cast<std::uintptr_t>(h) < PIN);
+    return h;
+  }
+  catch(...)
+  {
+    detail::replica_deallocate(block);
+    throw;
+  }
+}
+
+template <class ValueType>
+void replicated_mvcc<ValueType>::destroy_holder(holder *h) MVCC11_NOEXCEPT(true)
+{
+  h->~holder();
+  detail::replica_deallocate(h);
+}
+
+// Moves the pins still counted in a swapped out replica word onto its
+// holder, freeing the holder if every one of them was already dropped.
+template <class ValueType>
+void replicated_mvcc<ValueType>::retire(std::uint64_t word) MVCC11_NOEXCEPT(true)
+{
+  auto const h = holder_of(word);
+  if(h == nullptr)
+    return;
+
+  auto const pins = pins_of(word);
+  if(h->detached_pins.fetch_add(pins, std::memory_order_acq_rel) + pins == 0)
+    destroy_holder(h);
+}
+
+// Drops a pin on `h` taken through `r`. While `h` is still in the replica,
+// that is taking one off the replica's count; once it has been swapped
+// out, the pin lives on the holder instead. Every publish installs a new
+// holder, and ours cannot be freed and its address reused while we pin
+// it, so finding its address in the replica means it was never swapped
+// out.
+template <class ValueType>
+void replicated_mvcc<ValueType>::unpin(replica &r, holder *h, std::uint64_t pinned) MVCC11_NOEXCEPT(true)
+{
+  auto expected = pinned;
+  while(holder_of(expected) == h)
+  {
+    auto const unpinned =
+      r.word.compare_exchange_weak(
+        expected,
+        expected - PIN,
+        std::memory_order_release,
+        std::memory_order_relaxed);
+
+    if(unpinned)
+      return;
+  }
+
+  if(h->detached_pins.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    destroy_holder(h);
+}
+
+template <class ValueType>
+void replicated_mvcc<ValueType>::init_replicas(replication config)
+{
+  cores_per_replica_ = config.cores_per_replica > 0 ? config.cores_per_replica : 1;
+  replica_of_cpu_ = config.replica_of_cpu;
+
+  replica_count_ = config.replica_count;
+  if(replica_count_ == 0)
+  {
+    size_t cores = std::thread::hardware_concurrency();
+    if(cores == 0)
+      cores = 1;
+
+    replica_count_ = (cores + cores_per_replica_ - 1) / cores_per_replica_;
+  }
+  replicas_ = static_cast<replica *>(detail::replica_allocate(replica_count_ * sizeof(replica)));
+  for(size_t i = 0; i < replica_count_; ++i)
+  {
+    auto const r = new (&replicas_[i]) replica;
+    r->word.store(0, std::memory_order_relaxed);
+  }
+
+  try
+  {
+    this->publish(master_.current());
+  }
+  catch(...)
+  {
+    this->destroy_replicas();
+    throw;
+  }
+}
+
+// Only to be called once no reader is left, so every count is zero.
+template <class ValueType>
+void replicated_mvcc<ValueType>::destroy_replicas() MVCC11_NOEXCEPT(true)
+{
+  for(size_t i = 0; i < replica_count_; ++i)
+  {
+    retire(replicas_[i].word.load(std::memory_order_acquire));
+    replicas_[i].~replica();
+  }
+  detail::replica_deallocate(replicas_);
+}
+
+// Installs `published` in every replica that holds an older version.
+template <class ValueType>
+auto replicated_mvcc<ValueType>::publish(const_snapshot_ptr const &published)
+  -> const_snapshot_ptr
+{
+  if(published == nullptr)
+    return published;
+
+  std::lock_guard<std::mutex> lock{publish_mutex_};
+
+  for(size_t i = 0; i < replica_count_; ++i)
+  {
+    auto &r = replicas_[i];
+
+    auto const installed = holder_of(r.word.load(std::memory_order_acquire));
+    if(installed != nullptr && installed->snapshot->version >= published->version)
+      continue;
+
+    auto const desired = reinterpret_cast<std::uintptr_t>(make_holder(published));
+    retire(r.word.exchange(desired, std::memory_order_acq_rel));
+  }
+
+  return published;
+}
+
+template <class ValueType>
+auto replicated_mvcc<ValueType>::local_replica() MVCC11_NOEXCEPT(true) -> replica &
+{
+#ifdef __linux__
+  int const cpu = sched_getcpu();
+  size_t const core = cpu >= 0 ? static_cast<size_t>(cpu) : 0;
+#else
+  size_t const core = std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+
+  auto const index = replica_of_cpu_ != nullptr ? replica_of_cpu_(core) : core / cores_per_replica_;
+  return replicas_[index % replica_count_];
+}
+
+} // namespace mvcc11
+
+#endif // MVCC11_REPLICATED_MVCC_HPP
@@ -0,0 +1,616 @@
+/*
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  Version 2, December 2004
+
+  Copyright (C) 2014 Kenneth Ho <ken@fsfoundry.org>
+
+  Everyone is permitted to copy and distribute verbatim or modified
+  copies of this license document, and changing it is allowed as long
+  as the name is changed.
+
+  DO WHAT THE FUCK YOU WANT TO PUBLIC LICENSE
+  TERMS AND CONDITIONS FOR COPYING, DISTRIBUTION AND MODIFICATION
+
+  0. You just DO WHAT THE FUCK YOU WANT TO.
+*/
+#ifndef MVCC11_SHM_MVCC_HPP
+#define MVCC11_SHM_MVCC_HPP
+
+#include <mvcc11/mvcc.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <system_error>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mvcc11 {
+
+template <class ValueType>
+struct shm_snapshot
+{
+  using value_type = ValueType;
+
+  size_t version;
+  value_type value;
+};
+
+namespace detail {
+
+// Layout of a shm_mvcc segment: a header followed by slot_count slots.
+// Everything in it is addressed by slot index, never by pointer, since
+// each process maps the segment at a different address.
+struct shm_header
+{
+  static std::uint32_t const MAGIC = 0x6d766363; // "mvcc"
+
+  std::atomic<std::uint32_t> ready;
+  std::uint32_t slot_count;
+  std::uint64_t slot_size;
+
+  // Version of the current snapshot in the upper 48 bits, its slot index
+  // in the lower 16 bits.
+  std::atomic<std::uint64_t> current;
+};
+
+template <class ValueType>
+struct shm_slot
+{
+  // Set while a writer owns the slot; the lower bits count the readers
+  // that have it pinned.
+  static std::uint32_t const WRITER = 0x80000000u;
+
+  std::atomic<std::uint32_t> refs;
+  shm_snapshot<ValueType> snapshot;
+};
+
+inline std::uint64_t shm_pack(size_t version, size_t index) MVCC11_NOEXCEPT(true)
+{
+  return (static_cast<std::uint64_t>(version) << 16) | static_cast<std::uint16_t>(index);
+}
+inline size_t shm_version(std::uint64_t current) MVCC11_NOEXCEPT(true)
+{
+  return static_cast<size_t>(current >> 16);
+}
+inline size_t shm_index(std::uint64_t current) MVCC11_NOEXCEPT(true)
+{
+  return static_cast<size_t>(current & 0xffffu);
+}
+
+} // namespace detail
+
+// Pins a snapshot in a shm_mvcc segment for as long as it is alive. Like an
+// iterator, it must not outlive the shm_mvcc it was obtained from.
+template <class ValueType>
+class shm_snapshot_ptr
+{
+public:
+  using element_type = shm_snapshot<ValueType> const;
+
+  shm_snapshot_ptr() MVCC11_NOEXCEPT(true);
+  shm_snapshot_ptr(std::nullptr_t) MVCC11_NOEXCEPT(true);
+
+  shm_snapshot_ptr(shm_snapshot_ptr const &other) MVCC11_NOEXCEPT(true);
+  shm_snapshot_ptr(shm_snapshot_ptr &&other) MVCC11_NOEXCEPT(true);
+
+  ~shm_snapshot_ptr();
+
+  shm_snapshot_ptr& operator=(shm_snapshot_ptr other) MVCC11_NOEXCEPT(true);
+
+  element_type* get() const MVCC11_NOEXCEPT(true);
+  element_type& operator*() const MVCC11_NOEXCEPT(true);
+  element_type* operator->() const MVCC11_NOEXCEPT(true);
+
+  explicit operator bool() const MVCC11_NOEXCEPT(true);
+
+  friend bool operator==(shm_snapshot_ptr const &lhs, shm_snapshot_ptr const &rhs) MVCC11_NOEXCEPT(true)
+  {
+    return lhs.slot_ == rhs.slot_;
+  }
+  friend bool operator!=(shm_snapshot_ptr const &lhs, shm_snapshot_ptr const &rhs) MVCC11_NOEXCEPT(true)
+  {
+    return lhs.slot_ != rhs.slot_;
+  }
+
+private:
+  template <class>
+  friend class shm_mvcc;
+
+  using slot_type = detail::shm_slot<ValueType>;
+
+  // Adopts a pin already taken on `slot`.
+  explicit shm_snapshot_ptr(slot_type *slot) MVCC11_NOEXCEPT(true);
+
+  slot_type *slot_;
+};
+
+// An mvcc whose snapshots live in a named POSIX shared memory segment, so
+// several processes can publish and read the same versioned object
+// without each holding a copy.
+//
+// The segment holds a fixed number of snapshot slots. A publish writes the
+// new value into a slot that is neither current nor pinned by a reader, then
+// CASes the (version, slot) word in the segment header. Readers pin a slot
+// by bumping its refcount. Hence up to slot_count - 2 older snapshots may be
+// held at once; beyond that, overwrite() and update() wait for readers to
+// let go, while try_update_xxx() fail once they run out of time.
+//
+// update() and try_update_xxx() construct the updater's result right in its
+// slot, so values too large for the stack are fine.
+//
+// ValueType must be trivially copyable. Pins held by a process that dies
+// are never released, which leaks their slots until the segment is
+// recreated.
+template <class ValueType>
+class shm_mvcc
+{
+  static_assert(std::is_trivially_copyable<ValueType>::value,
+                "shm_mvcc requires a trivially copyable value");
+  static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+                "shm_mvcc requires address-free (lock-free) atomics");
+
+public:
+  using value_type = ValueType;
+  using snapshot_type = shm_snapshot<value_type>;
+  using const_snapshot_ptr = shm_snapshot_ptr<value_type>;
+
+  static size_t const MAX_SLOT_COUNT = 0x10000;
+
+  // Creates segment `name` with `slot_count` slots, publishing `value` as
+  // version 0. Throws std::system_error if it already exists.
+  shm_mvcc(char const *name, size_t slot_count, value_type const &value);
+
+  // Opens the existing segment `name`, waiting for its creator to finish
+  // initializing it.
+  explicit shm_mvcc(char const *name);
+
+  shm_mvcc(shm_mvcc const &other) = delete;
+  shm_mvcc& operator=(shm_mvcc const &other) = delete;
+
+  // Unmaps the segment; it stays around until remove() is called.
+  ~shm_mvcc();
+
+  static bool remove(char const *name) MVCC11_NOEXCEPT(true);
+
+  size_t slot_count() const MVCC11_NOEXCEPT(true);
+
+  const_snapshot_ptr current() MVCC11_NOEXCEPT(true);
+  const_snapshot_ptr operator*() MVCC11_NOEXCEPT(true);
+  const_snapshot_ptr operator->() MVCC11_NOEXCEPT(true);
+
+  const_snapshot_ptr overwrite(value_type const &value);
+
+  template <class Updater>
+  const_snapshot_ptr update(Updater updater);
+
+  template <class Updater>
+  const_snapshot_ptr try_update(Updater updater);
+
+  template <class Updater, class Clock, class Duration>
+  const_snapshot_ptr try_update_until(
+    Updater updater,
+    std::chrono::time_point<Clock, Duration> const &timeout_time);
+
+  template <class Updater, class Rep, class Period>
+  const_snapshot_ptr try_update_for(
+    Updater updater,
+    std::chrono::duration<Rep, Period> const &timeout_duration);
+
+private:
+  using slot_type = detail::shm_slot<value_type>;
+
+  static size_t segment_size(size_t slot_count) MVCC11_NOEXCEPT(true);
+
+  void map(int fd, size_t size);
+
+  slot_type& slot(size_t index) const MVCC11_NOEXCEPT(true);
+
+  const_snapshot_ptr pin_current(std::uint64_t &current) MVCC11_NOEXCEPT(true);
+  bool try_claim_free_slot(size_t &index) MVCC11_NOEXCEPT(true);
+  void release_claim(size_t index) MVCC11_NOEXCEPT(true);
+  const_snapshot_ptr publish(size_t index, std::uint64_t expected) MVCC11_NOEXCEPT(true);
+
+  template <class Updater>
+  const_snapshot_ptr try_update_impl(Updater &updater);
+
+  size_t size_;
+  detail::shm_header *header_;
+};
+
+template <class ValueType>
+shm_snapshot_ptr<ValueType>::shm_snapshot_ptr() MVCC11_NOEXCEPT(true)
+: slot_{nullptr}
+{}
+template <class ValueType>
+shm_snapshot_ptr<ValueType>::shm_snapshot_ptr(std::nullptr_t) MVCC11_NOEXCEPT(true)
+: slot_{nullptr}
+{}
+template <class ValueType>
+shm_snapshot_ptr<ValueType>::shm_snapshot_ptr(slot_type *slot) MVCC11_NOEXCEPT(true)
+: slot_{slot}
+{}
+template <class ValueType>
+shm_snapshot_ptr<ValueType>::shm_snapshot_ptr(shm_snapshot_ptr const &other) MVCC11_NOEXCEPT(true)
+: slot_{other.slot_}
+{
+  if(slot_ != nullptr)
+    slot_->refs.fetch_add(1, std::memory_order_relaxed);
+}
+template <class ValueType>
+shm_snapshot_ptr<ValueType>::shm_snapshot_ptr(shm_snapshot_ptr &&other) MVCC11_NOEXCEPT(true)
+: slot_{other.slot_}
+{
+  other.slot_ = nullptr;
+}
+template <class ValueType>
+shm_snapshot_ptr<ValueType>::~shm_snapshot_ptr()
+{
+  if(slot_ != nullptr)
+    slot_->refs.fetch_sub(1, std::memory_order_release);
+}
+
+template <class ValueType>
+auto shm_snapshot_ptr<ValueType>::operator=(shm_snapshot_ptr other) MVCC11_NOEXCEPT(true) -> shm_snapshot_ptr &
+{
+  std::swap(slot_, other.slot_);
+
+  return *this;
+}
+
+template <class ValueType>
+auto shm_snapshot_ptr<ValueType>::get() const MVCC11_NOEXCEPT(true) -> element_type *
+{
+  return slot_ != nullptr ? &slot_->snapshot : nullptr;
+}
+template <class ValueType>
+auto shm_snapshot_ptr<ValueType>::operator*() const MVCC11_NOEXCEPT(true) -> element_type &
+{
+  return slot_->snapshot;
+}
+template <class ValueType>
+auto shm_snapshot_ptr<ValueType>::operator->() const MVCC11_NOEXCEPT(true) -> element_type *
+{
+  return &slot_->snapshot;
+}
+template <class ValueType>
+shm_snapshot_ptr<ValueType>::operator bool() const MVCC11_NOEXCEPT(true)
+{
+  return slot_ != nullptr;
+}
+
+
+template <class ValueType>
+shm_mvcc<ValueType>::shm_mvcc(char const *name, size_t slot_count, value_type const &value)
+: size_{segment_size(slot_count)}
+, header_{nullptr}
+{
+  if(slot_count < 2 || slot_count > MAX_SLOT_COUNT)
+    throw std::system_error(EINVAL, std::system_category(), "shm_mvcc slot_count");
+
+  int const fd = ::shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if(fd < 0)
+    throw std::system_error(errno, std::system_category(), "shm_open");
+
+  if(::ftruncate(fd, static_cast<off_t>(size_)) != 0)
+  {
+    int const error = errno;
+    ::close(fd);
+    ::shm_unlink(name);
+    throw std::system_error(error, std::system_category(), "ftruncate");
+  }
+
+  this->map(fd, size_);
+
+  header_->slot_count = static_cast<std::uint32_t>(slot_count);
+  header_->slot_size = sizeof(slot_type);
+  for(size_t i = 0; i < slot_count; ++i)
+  {
+    auto &s = this->slot(i);
+    new (&s.refs) std::atomic<std::uint32_t>{0};
+    s.snapshot.version = 0;
+  }
+  this->slot(0).snapshot.value = value;
+
+  new (&header_->current) std::atomic<std::uint64_t>{detail::shm_pack(0, 0)};
+  header_->ready.store(detail::shm_header::MAGIC, std::memory_order_release);
+}
+
+template <class ValueType>
+shm_mvcc<ValueType>::shm_mvcc(char const *name)
+: size_{0}
+, header_{nullptr}
+{
+  int const fd = ::shm_open(name, O_RDWR, 0600);
+  if(fd < 0)
+    throw std::system_error(errno, std::system_category(), "shm_open");
+
+  // The creator may not have sized the segment yet.
+  struct stat st;
+  while(true)
+  {
+    if(::fstat(fd, &st) != 0)
+    {
+      int const error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::system_category(), "fstat");
+    }
+    if(static_cast<size_t>(st.st_size) >= sizeof(detail::shm_header))
+      break;
+
+    std::this_thread::yield();
+  }
+
+  this->map(fd, static_cast<size_t>(st.st_size));
+
+  while(header_->ready.load(std::memory_order_acquire) != detail::shm_header::MAGIC)
+    std::this_thread::yield();
+
+  if(header_->slot_size != sizeof(slot_type)
+     || size_ < segment_size(header_->slot_count))
+  {
+    ::munmap(header_, size_);
+    throw std::system_error(EINVAL, std::system_category(), "shm_mvcc value type mismatch");
+  }
+}
+
+template <class ValueType>
+shm_mvcc<ValueType>::~shm_mvcc()
+{
+  ::munmap(header_, size_);
+}
+
+template <class ValueType>
+bool shm_mvcc<ValueType>::remove(char const *name) MVCC11_NOEXCEPT(true)
+{
+  return ::shm_unlink(name) == 0;
+}
+
+template <class ValueType>
+size_t shm_mvcc<ValueType>::slot_count() const MVCC11_NOEXCEPT(true)
+{
+  return header_->slot_count;
+}
+
+template <class ValueType>
+auto shm_mvcc<ValueType>::current() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  std::uint64_t current;
+  return this->pin_current(current);
+}
+template <class ValueType>
+auto shm_mvcc<ValueType>::operator*() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  return this->current();
+}
+template <class ValueType>
+auto shm_mvcc<ValueType>::operator->() MVCC11_NOEXCEPT(true) -> const_snapshot_ptr
+{
+  return this->current();
+}
+
+template <class ValueType>
+auto shm_mvcc<ValueType>::overwrite(value_type const &value) -> const_snapshot_ptr
+{
+  size_t index;
+  while(!this->try_claim_free_slot(index))
+    std::this_thread::yield();
+
+  auto &desired = this->slot(index);
+  desired.snapshot.value = value;
+
+  while(true)
+  {
+    auto expected = header_->current.load();
+    desired.snapshot.version = detail::shm_version(expected) + 1;
+
+    auto overwritten = this->publish(index, expected);
+    if(overwritten != nullptr)
+      return overwritten;
+  }
+}
+
+template <class ValueType>
+template <class Updater>
+auto shm_mvcc<ValueType>::update(Updater updater) -> const_snapshot_ptr
+{
+  while(true)
+  {
+    auto updated = this->try_update_impl(updater);
+    if(updated != nullptr)
+      return updated;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(MVCC11_CONTENSION_BACKOFF_SLEEP_MS));
+  }
+}
+
+template <class ValueType>
+template <class Updater>
+auto shm_mvcc<ValueType>::try_update(Updater updater) -> const_snapshot_ptr
+{
+  return this->try_update_impl(updater);
+}
+
+template <class ValueType>
+template <class Updater, class Clock, class Duration>
+auto shm_mvcc<ValueType>::try_update_until(
+  Updater updater,
+  std::chrono::time_point<Clock, Duration> const &timeout_time)
+  -> const_snapshot_ptr
+{
+  while(true)
+  {
+    auto updated = this->try_update_impl(updater);
+
+    if(updated != nullptr)
+      return updated;
+
+    if(Clock::now() > timeout_time)
+      return nullptr;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(MVCC11_CONTENSION_BACKOFF_SLEEP_MS));
+  }
+}
+
+template <class ValueType>
+template <class Updater, class Rep, class Period>
+auto shm_mvcc<ValueType>::try_update_for(
+  Updater updater,
+  std::chrono::duration<Rep, Period> const &timeout_duration)
+  -> const_snapshot_ptr
+{
+  auto timeout_time = std::chrono::high_resolution_clock::now() + timeout_duration;
+  return this->try_update_until(updater, timeout_time);
+}
+
+template <class ValueType>
+size_t shm_mvcc<ValueType>::segment_size(size_t slot_count) MVCC11_NOEXCEPT(true)
+{
+  auto const header_size =
+    (sizeof(detail::shm_header) + alignof(slot_type) - 1) / alignof(slot_type) * alignof(slot_type);
+  return header_size + slot_count * sizeof(slot_type);
+}
+
+template <class ValueType>
+void shm_mvcc<ValueType>::map(int fd, size_t size)
+{
+  void *addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int const error = errno;
+  ::close(fd);
+
+  if(addr == MAP_FAILED)
+    throw std::system_error(error, std::system_category(), "mmap");
+
+  size_ = size;
+  header_ = static_cast<detail::shm_header *>(addr);
+}
+
+template <class ValueType>
+auto shm_mvcc<ValueType>::slot(size_t index) const MVCC11_NOEXCEPT(true) -> slot_type &
+{
+  auto const base = reinterpret_cast<char *>(header_) + segment_size(0);
+  return reinterpret_cast<slot_type *>(base)[index];
+}
+
+// Pins the current slot. The pin only counts if no writer owned the slot
+// when we took it and the slot is still current afterwards; otherwise we
+// let go and retry.
+template <class ValueType>
+auto shm_mvcc<ValueType>::pin_current(std::uint64_t &current) MVCC11_NOEXCEPT(true)
+  -> const_snapshot_ptr
+{
+  while(true)
+  {
+    current = header_->current.load();
+    auto &s = this->slot(detail::shm_index(current));
+    auto const refs = s.refs.fetch_add(1);
+
+    if((refs & slot_type::WRITER) == 0 && header_->current.load() == current)
+      return const_snapshot_ptr{&s};
+
+    s.refs.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+// Takes exclusive ownership of a slot that is neither current nor pinned,
+// making a single pass over the slots. A current slot nobody has pinned has
+// no refs either, and our view of which slot is current may be stale, so
+// check again once it is claimed.
+template <class ValueType>
+bool shm_mvcc<ValueType>::try_claim_free_slot(size_t &index) MVCC11_NOEXCEPT(true)
+{
+  auto const current = detail::shm_index(header_->current.load());
+  for(size_t i = 0; i < header_->slot_count; ++i)
+  {
+    if(i == current)
+      continue;
+
+    std::uint32_t free = 0;
+    if(!this->slot(i).refs.compare_exchange_strong(free, slot_type::WRITER))
+      continue;
+
+    if(detail::shm_index(header_->current.load()) != i)
+    {
+      index = i;
+      return true;
+    }
+
+    this->release_claim(i);
+  }
+
+  return false;
+}
+
+template <class ValueType>
+void shm_mvcc<ValueType>::release_claim(size_t index) MVCC11_NOEXCEPT(true)
+{
+  this->slot(index).refs.fetch_sub(slot_type::WRITER, std::memory_order_release);
+}
+
+// Makes the claimed slot `index` current if the current word is still
+// `expected`. On success, the writer's claim turns into a reader pin held
+// by the returned pointer; on failure the slot stays claimed.
+template <class ValueType>
+auto shm_mvcc<ValueType>::publish(size_t index, std::uint64_t expected) MVCC11_NOEXCEPT(true)
+  -> const_snapshot_ptr
+{
+  auto &desired = this->slot(index);
+
+  auto const published =
+    header_->current.compare_exchange_strong(
+      expected,
+      detail::shm_pack(desired.snapshot.version, index));
+
+  if(published)
+  {
+    desired.refs.fetch_sub(slot_type::WRITER - 1, std::memory_order_release);
+    return const_snapshot_ptr{&desired};
+  }
+
+  return nullptr;
+}
+
+// Fails without calling the updater if no slot is free.
+template <class ValueType>
+template <class Updater>
+auto shm_mvcc<ValueType>::try_update_impl(Updater &updater) -> const_snapshot_ptr
+{
+  std::uint64_t expected;
+  auto const pinned = this->pin_current(expected);
+  auto const const_expected_version = pinned->version;
+  auto const &const_expected_value = pinned->value;
+
+  size_t index;
+  if(!this->try_claim_free_slot(index))
+    return nullptr;
+
+  auto &desired = this->slot(index);
+  desired.snapshot.version = const_expected_version + 1;
+  try
+  {
+    // value_type is trivially destructible, so the old value needs no
+    // destruction before it is constructed over.
+    new (&desired.snapshot.value) value_type(updater(const_expected_version, const_expected_value));
+  }
+  catch(...)
+  {
+    this->release_claim(index);
+    throw;
+  }
+
+  auto updated = this->publish(index, expected);
+  if(updated == nullptr)
+    this->release_claim(index);
+
+  return updated;
+}
+
+} // namespace mvcc11
+
+#endif // MVCC11_SHM_MVCC_HPP
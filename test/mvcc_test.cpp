@@ -15,12 +15,25 @@
 */
 //#define MVCC11_NO_PTHREAD_SPINLOCK 1
 
+// Keeps the tests that run into it short.
+#define MVCC11_STARVATION_DEFER_MAX_MS 50
+
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE MVCC_TEST
 #include <boost/test/unit_test.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/mpl/list.hpp>
 
 #include <mvcc11/mvcc.hpp>
+#include <mvcc11/replicated_mvcc.hpp>
+#include <mvcc11/atomic_mvcc.hpp>
+#include <mvcc11/shm_mvcc.hpp>
+#include <mvcc11/boost_shared_ptr_policy.hpp>
+#include <mvcc11/std_shared_ptr_policy.hpp>
+#include <mvcc11/intrusive_ptr_policy.hpp>
+#ifdef __cpp_lib_atomic_shared_ptr
+#include <mvcc11/atomic_shared_ptr_policy.hpp>
+#endif
 
 #include <atomic>
 #include <string>
@@ -29,6 +42,14 @@
 #include <condition_variable>
 #include <future>
 #include <cassert>
+#include <vector>
+#include <type_traits>
+#include <stdexcept>
+#include <array>
+#include <memory>
+
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace chrono;
@@ -417,6 +438,117 @@ BOOST_AUTO_TEST_CASE(test_try_update_for_fails_with_disturber)
   BOOST_REQUIRE(snapshot->value == DISTURBED);
 }
 
+// A slow updater is disturbed by a stream of overwrites that would
+// otherwise starve it forever. Once it runs out of optimistic attempts,
+// the disturber has to defer to it, so update() completes within a
+// bounded number of attempts.
+BOOST_AUTO_TEST_CASE(test_update_is_not_starved_by_overwrites)
+{
+  atomic<bool> updater_done{false};
+  atomic<size_t> update_attempts{0};
+
+  mvcc<string> x{INIT};
+  auto disturber =
+    async(launch::async,
+          [&] {
+            size_t overwrites = 0;
+            auto deadline = hr_now() + seconds(10);
+            while(!updater_done && hr_now() < deadline)
+            {
+              x.overwrite(DISTURBED);
+              ++overwrites;
+            }
+            return overwrites;
+          });
+
+  auto updated = x.update([&](size_t, string const &) {
+      ++update_attempts;
+      this_thread::sleep_for(milliseconds(5));
+      return UPDATED;
+    });
+  updater_done = true;
+
+  BOOST_REQUIRE(disturber.get() > 0);
+  BOOST_REQUIRE(updated != nullptr);
+  BOOST_REQUIRE(updated->value == UPDATED);
+  BOOST_REQUIRE(update_attempts > 0);
+  BOOST_REQUIRE(update_attempts <= MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS + 2);
+}
+
+// Writers keep deferring to an attempt that takes longer than
+// MVCC11_STARVATION_DEFER_MAX_MS, as long as it is no slower than the
+// updater's earlier attempts.
+BOOST_AUTO_TEST_CASE(test_slow_update_is_not_starved_by_overwrites)
+{
+  auto const UPDATE_TIME = milliseconds(3 * MVCC11_STARVATION_DEFER_MAX_MS);
+  atomic<bool> updater_done{false};
+  atomic<size_t> update_attempts{0};
+
+  mvcc<string> x{INIT};
+  auto disturber =
+    async(launch::async,
+          [&] {
+            size_t overwrites = 0;
+            auto deadline = hr_now() + seconds(10);
+            while(!updater_done && hr_now() < deadline)
+            {
+              x.overwrite(DISTURBED);
+              ++overwrites;
+            }
+            return overwrites;
+          });
+
+  auto updated = x.update([&](size_t, string const &) {
+      ++update_attempts;
+      this_thread::sleep_for(UPDATE_TIME);
+      return UPDATED;
+    });
+  updater_done = true;
+
+  BOOST_REQUIRE(disturber.get() > 0);
+  BOOST_REQUIRE(updated != nullptr);
+  BOOST_REQUIRE(updated->value == UPDATED);
+  BOOST_REQUIRE(update_attempts <= MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS + 2);
+}
+
+// An updater that publishes to its own mvcc keeps failing until it stops
+// doing so, including after it takes the starvation ticket.
+BOOST_AUTO_TEST_CASE(test_update_may_write_to_its_own_mvcc)
+{
+  size_t const SELF_WRITES = MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS + 1;
+  size_t calls = 0;
+
+  mvcc<int> x{0};
+  auto updated = x.update([&](size_t, int value) {
+      if(++calls <= SELF_WRITES)
+        x.overwrite(-1);
+      return value + 1;
+    });
+
+  BOOST_REQUIRE(updated != nullptr);
+  BOOST_REQUIRE(updated->version == SELF_WRITES + 1);
+  BOOST_REQUIRE(updated->value == 0);
+  BOOST_REQUIRE(calls == SELF_WRITES + 1);
+}
+
+// A starving updater that waits on another writer only delays it for a
+// bounded time rather than deadlocking with it.
+BOOST_AUTO_TEST_CASE(test_update_may_wait_on_another_writer)
+{
+  size_t calls = 0;
+
+  mvcc<int> x{0};
+  auto updated = x.update([&](size_t, int value) {
+      if(++calls <= MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS + 1)
+        async(launch::async, [&] { x.overwrite(-1); }).get();
+      return value + 1;
+    });
+
+  BOOST_REQUIRE(updated != nullptr);
+  BOOST_REQUIRE(updated->value == 0);
+  BOOST_REQUIRE(calls == MVCC11_UPDATE_OPTIMISTIC_ATTEMPTS + 2);
+}
+
 
 struct Base { Base(int n ) : n{n}{} int n; };
 struct Derived : Base {
@@ -441,4 +573,701 @@ BOOST_AUTO_TEST_CASE(test_conversion_matching_type)
   BOOST_REQUIRE(mb2.current()->value.n == 1);
 }
 
+BOOST_AUTO_TEST_CASE(test_replicated_current_overwrite_and_update)
+{
+  replicated_mvcc<string> x{replication{1}, INIT};
+  BOOST_REQUIRE(x.replica_count() >= 1);
+
+  auto init = x.current();
+  BOOST_REQUIRE(init == *x);
+  BOOST_REQUIRE(init->version == 0);
+  BOOST_REQUIRE(init->value == INIT);
+
+  auto overwritten = x.overwrite(OVERWRITTEN);
+  BOOST_REQUIRE(overwritten == x.current());
+  BOOST_REQUIRE(overwritten->version == 1);
+  BOOST_REQUIRE(overwritten->value == OVERWRITTEN);
+
+  auto updated = x.update([](size_t version, string const &value) {
+      BOOST_REQUIRE(version == 1);
+      BOOST_REQUIRE(value == OVERWRITTEN);
+      return UPDATED;
+    });
+  BOOST_REQUIRE(updated == x.current());
+  BOOST_REQUIRE(updated->version == 2);
+  BOOST_REQUIRE(updated->value == UPDATED);
+
+  BOOST_REQUIRE(init->value == INIT);
+  BOOST_REQUIRE(overwritten->value == OVERWRITTEN);
+}
+
+// Many publishers racing to fan out to the replicas. Readers must always
+// see a consistent snapshot, and the last publish must have reached every
+// replica once all publishers have returned.
+namespace {
+
+// Replica that replica_of_reader() maps the calling thread to, whatever CPU
+// it runs on.
+thread_local size_t reader_replica = 0;
+
+size_t replica_of_reader(size_t)
+{
+  return reader_replica;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(test_replicated_concurrent_updates)
+{
+  size_t const REPLICAS = 4;
+  size_t const PUBLISHERS = 4;
+  size_t const PUBLISHES = 1000;
+
+  replicated_mvcc<size_t> x{replication{1, REPLICAS, &replica_of_reader}, 0};
+  BOOST_REQUIRE(x.replica_count() == REPLICAS);
+  atomic<bool> done{false};
+
+  vector<future<bool>> readers;
+  for(size_t i = 0; i < REPLICAS; ++i)
+    readers.push_back(
+      async(launch::async,
+            [&, i] {
+              reader_replica = i;
+
+              bool consistent = true;
+              size_t last_version = 0;
+              while(!done)
+              {
+                auto snapshot = x.current();
+                consistent = consistent
+                  && snapshot->version == snapshot->value
+                  && snapshot->version >= last_version;
+                last_version = snapshot->version;
+              }
+              return consistent;
+            }));
+
+  vector<future<void>> publishers;
+  for(size_t i = 0; i < PUBLISHERS; ++i)
+    publishers.push_back(
+      async(launch::async,
+            [&] {
+              for(size_t n = 0; n < PUBLISHES; ++n)
+                x.update([](size_t, size_t value) { return value + 1; });
+            }));
+  for(auto &p : publishers)
+    p.get();
+  done = true;
+
+  for(auto &r : readers)
+    BOOST_REQUIRE(r.get());
+
+  for(size_t i = 0; i < REPLICAS; ++i)
+  {
+    reader_replica = i;
+    BOOST_REQUIRE(x.current()->version == PUBLISHERS * PUBLISHES);
+  }
+  reader_replica = 0;
+}
+
+// A superseded snapshot goes away once the last reader lets go of it, and
+// the rest go away with the replicated_mvcc.
+BOOST_AUTO_TEST_CASE(test_replicated_frees_superseded_snapshots)
+{
+  auto first = make_shared<int>(1);
+  weak_ptr<int> const first_value{first};
+  auto second = make_shared<int>(2);
+  weak_ptr<int> const second_value{second};
+
+  {
+    replicated_mvcc<shared_ptr<int>> x{replication{1}, std::move(first)};
+
+    auto held = x.current();
+    x.overwrite(std::move(second));
+    BOOST_REQUIRE(*x.current()->value == 2);
+    BOOST_REQUIRE(!first_value.expired());
+
+    held = nullptr;
+    BOOST_REQUIRE(first_value.expired());
+    BOOST_REQUIRE(!second_value.expired());
+  }
+  BOOST_REQUIRE(second_value.expired());
+}
+
+BOOST_AUTO_TEST_CASE(test_mvcc_for_selects_atomic_mvcc_for_small_values)
+{
+  enum class state : unsigned char { idle, busy };
+  struct pair16 { int16_t a; int16_t b; };
+
+  static_assert(is_same<mvcc_for<int>, atomic_mvcc<int>>::value, "");
+  static_assert(is_same<mvcc_for<state>, atomic_mvcc<state>>::value, "");
+  static_assert(is_same<mvcc_for<pair16>, atomic_mvcc<pair16>>::value, "");
+  static_assert(is_same<mvcc_for<float>, atomic_mvcc<float>>::value, "");
+  static_assert(is_same<mvcc_for<double>, mvcc<double>>::value, "");
+  static_assert(is_same<mvcc_for<int64_t>, mvcc<int64_t>>::value, "");
+  static_assert(is_same<mvcc_for<string>, mvcc<string>>::value, "");
+  static_assert(is_same<mvcc_for<Base>, atomic_mvcc<Base>>::value, "");
+
+  // Snapshots held by value stay as cheap to copy as the value itself.
+  static_assert(is_trivially_copyable<atomic_mvcc<int>::const_snapshot_ptr>::value, "");
+  static_assert(is_same<decltype(atomic_snapshot<int>::version), uint32_t>::value, "");
+
+  BOOST_REQUIRE(atomic_mvcc<int>{}.is_lock_free());
+
+  atomic_mvcc<state> s{state::busy};
+  BOOST_REQUIRE(s.current()->value == state::busy);
+  BOOST_REQUIRE(s.overwrite(state::idle)->value == state::idle);
+
+  atomic_mvcc<pair16> p{pair16{1, -2}};
+  auto updated = p.update([](size_t, pair16 const &value) {
+      return pair16{static_cast<int16_t>(value.a + 1), value.b};
+    });
+  BOOST_REQUIRE(updated->value.a == 2);
+  BOOST_REQUIRE(updated->value.b == -2);
+}
+
+BOOST_AUTO_TEST_CASE(test_atomic_snapshot_overwrite_and_isolation)
+{
+  atomic_mvcc<int> x{42};
+  BOOST_REQUIRE(atomic_mvcc<int>{}.current()->value == 0);
+
+  auto init = x.current();
+  BOOST_REQUIRE(init != nullptr);
+  BOOST_REQUIRE(init == *x);
+  BOOST_REQUIRE(init->version == 0);
+  BOOST_REQUIRE(init->value == 42);
+
+  auto overwritten = x.overwrite(43);
+  BOOST_REQUIRE(overwritten != init);
+  BOOST_REQUIRE(overwritten == x.current());
+  BOOST_REQUIRE(overwritten->version == 1);
+  BOOST_REQUIRE(overwritten->value == 43);
+
+  BOOST_REQUIRE(init->version == 0);
+  BOOST_REQUIRE(init->value == 42);
+
+  atomic_mvcc<int> y{x};
+  y.overwrite(44);
+  BOOST_REQUIRE(x.current()->value == 43);
+  BOOST_REQUIRE(y.current()->version == 2);
+  BOOST_REQUIRE(y.current()->value == 44);
+}
+
+BOOST_AUTO_TEST_CASE(test_atomic_try_update_fails_with_disturber)
+{
+  atomic_mvcc<float> x{1.5f};
+
+  auto updated = x.try_update([&](size_t version, float value) {
+      BOOST_REQUIRE(version == 0);
+      BOOST_REQUIRE(value == 1.5f);
+      x.overwrite(-1.0f);
+      return 2.5f;
+    });
+  BOOST_REQUIRE(updated == nullptr);
+  BOOST_REQUIRE(!updated);
+  BOOST_REQUIRE(x.current()->version == 1);
+  BOOST_REQUIRE(x.current()->value == -1.0f);
+
+  size_t attempts = 0;
+  updated = x.try_update_for([&](size_t, float value) {
+      if(++attempts == 1)
+        x.overwrite(-2.0f);
+      return value + 1;
+    },
+    seconds(1));
+  BOOST_REQUIRE(updated != nullptr);
+  BOOST_REQUIRE(attempts == 2);
+  BOOST_REQUIRE(updated->version == 3);
+  BOOST_REQUIRE(updated->value == -1.0f);
+}
+
+BOOST_AUTO_TEST_CASE(test_atomic_concurrent_updates)
+{
+  size_t const UPDATERS = 4;
+  size_t const UPDATES = 10000;
+
+  atomic_mvcc<uint32_t> x;
+  vector<future<void>> updaters;
+  for(size_t i = 0; i < UPDATERS; ++i)
+    updaters.push_back(
+      async(launch::async,
+            [&] {
+              for(size_t n = 0; n < UPDATES; ++n)
+                x.update([](size_t, uint32_t value) { return value + 1; });
+            }));
+  for(auto &u : updaters)
+    u.get();
+
+  BOOST_REQUIRE(x.current()->version == UPDATERS * UPDATES);
+  BOOST_REQUIRE(x.current()->value == UPDATERS * UPDATES);
+}
+
+namespace
+{
+  struct shm_pair
+  {
+    uint64_t first;
+    uint64_t second;
+  };
+
+  string shm_name(char const *test)
+  {
+    return "/mvcc11_" + string{test} + "_" + boost::lexical_cast<string>(getpid());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_shm_snapshot_overwrite_update_and_isolation)
+{
+  auto const name = shm_name("isolation");
+  shm_mvcc<int>::remove(name.c_str());
+
+  shm_mvcc<int> x{name.c_str(), 4, 1};
+  BOOST_REQUIRE(x.slot_count() == 4);
+  BOOST_CHECK_THROW((shm_mvcc<int>{name.c_str(), 4, 1}), system_error);
+
+  auto init = x.current();
+  BOOST_REQUIRE(init == *x);
+  BOOST_REQUIRE(init->version == 0);
+  BOOST_REQUIRE(init->value == 1);
+
+  // With 4 slots, two old snapshots can be held while writers keep
+  // publishing into the other two.
+  for(int n = 2; n <= 10; ++n)
+  {
+    auto overwritten = x.overwrite(n);
+    BOOST_REQUIRE(overwritten == x.current());
+    BOOST_REQUIRE(overwritten->version == static_cast<size_t>(n - 1));
+    BOOST_REQUIRE(overwritten->value == n);
+  }
+  BOOST_REQUIRE(init->version == 0);
+  BOOST_REQUIRE(init->value == 1);
+
+  auto updated = x.update([](size_t version, int value) {
+      BOOST_REQUIRE(version == 9);
+      BOOST_REQUIRE(value == 10);
+      return value + 1;
+    });
+  BOOST_REQUIRE(updated->version == 10);
+  BOOST_REQUIRE(updated->value == 11);
+
+  // `init` and `updated` are held, and try_update() pins the snapshot it
+  // updates from, so the disturbing overwrite takes the last free slot.
+  auto failed = x.try_update([&](size_t, int value) {
+      x.overwrite(-1);
+      return value + 1;
+    });
+  BOOST_REQUIRE(failed == nullptr);
+  BOOST_REQUIRE(x.current()->value == -1);
+
+  BOOST_REQUIRE(shm_mvcc<int>::remove(name.c_str()));
+}
+
+// Readers must never see a snapshot being written, i.e. a torn pair.
+BOOST_AUTO_TEST_CASE(test_shm_concurrent_readers_see_consistent_snapshots)
+{
+  auto const name = shm_name("consistency");
+  shm_mvcc<shm_pair>::remove(name.c_str());
+
+  shm_mvcc<shm_pair> x{name.c_str(), 4, shm_pair{0, 0}};
+  atomic<bool> done{false};
+
+  vector<future<bool>> readers;
+  for(size_t i = 0; i < 2; ++i)
+    readers.push_back(
+      async(launch::async,
+            [&] {
+              bool consistent = true;
+              while(!done)
+              {
+                auto snapshot = x.current();
+                consistent = consistent
+                  && snapshot->value.first == snapshot->value.second
+                  && snapshot->value.first == snapshot->version;
+              }
+              return consistent;
+            }));
+
+  size_t const PUBLISHES = 10000;
+  for(uint64_t n = 1; n <= PUBLISHES; ++n)
+    x.update([](size_t, shm_pair const &value) {
+        return shm_pair{value.first + 1, value.second + 1};
+      });
+  done = true;
+
+  for(auto &r : readers)
+    BOOST_REQUIRE(r.get());
+  BOOST_REQUIRE(x.current()->version == PUBLISHES);
+
+  shm_mvcc<shm_pair>::remove(name.c_str());
+}
+
+// With every slot but the current one pinned, try_update_xxx() give up
+// rather than wait for readers, and try_update_for() honors its timeout.
+BOOST_AUTO_TEST_CASE(test_shm_try_update_fails_without_free_slot)
+{
+  auto const name = shm_name("no_free_slot");
+  shm_mvcc<int>::remove(name.c_str());
+
+  shm_mvcc<int> x{name.c_str(), 3, 0};
+  auto held1 = x.current();
+  auto held2 = x.overwrite(1);
+  x.overwrite(2);
+
+  size_t calls = 0;
+  auto updater = [&](size_t, int value) {
+    ++calls;
+    return value + 1;
+  };
+
+  BOOST_REQUIRE(x.try_update(updater) == nullptr);
+
+  auto start = hr_now();
+  BOOST_REQUIRE(x.try_update_for(updater, milliseconds(100)) == nullptr);
+  BOOST_REQUIRE(hr_now() - start >= milliseconds(100));
+  BOOST_REQUIRE(calls == 0);
+
+  held1 = nullptr;
+  auto updated = x.try_update(updater);
+  BOOST_REQUIRE(updated != nullptr);
+  BOOST_REQUIRE(updated->value == 3);
+  BOOST_REQUIRE(calls == 1);
+
+  BOOST_REQUIRE(shm_mvcc<int>::remove(name.c_str()));
+}
+
+// The updater's result goes straight into its slot, never onto the stack.
+BOOST_AUTO_TEST_CASE(test_shm_update_value_larger_than_stack)
+{
+  using dataset = array<uint64_t, (size_t{1} << 21)>; // 16 MiB
+
+  auto const name = shm_name("large_value");
+  shm_mvcc<dataset>::remove(name.c_str());
+
+  unique_ptr<dataset> init{new dataset{}};
+  (*init)[0] = 1;
+  shm_mvcc<dataset> x{name.c_str(), 3, *init};
+
+  auto updated = x.update([](size_t, dataset const &value) {
+      return value;
+    });
+  BOOST_REQUIRE(updated->version == 1);
+  BOOST_REQUIRE(updated->value[0] == 1);
+  BOOST_REQUIRE(updated->value.back() == 0);
+
+  BOOST_REQUIRE(shm_mvcc<dataset>::remove(name.c_str()));
+}
+
+// Child processes open the segment by name. Readers check every snapshot
+// they see for consistency while a child writer and the parent publish
+// concurrently.
+BOOST_AUTO_TEST_CASE(test_shm_multi_process)
+{
+  auto const name = shm_name("multi_process");
+  shm_mvcc<shm_pair>::remove(name.c_str());
+
+  shm_mvcc<shm_pair> x{name.c_str(), 8, shm_pair{0, 0}};
+
+  size_t const READERS = 3;
+  size_t const PUBLISHES = 2000;
+  auto const increment = [](size_t, shm_pair const &value) {
+    return shm_pair{value.first + 1, value.second + 1};
+  };
+
+  vector<pid_t> children;
+  for(size_t i = 0; i < READERS; ++i)
+  {
+    pid_t const child = fork();
+    BOOST_REQUIRE(child >= 0);
+    if(child == 0)
+    {
+      shm_mvcc<shm_pair> y{name.c_str()};
+      bool ok = true;
+      size_t last_version = 0;
+      while(ok && last_version < 2 * PUBLISHES)
+      {
+        auto snapshot = y.current();
+        ok = snapshot->value.first == snapshot->value.second
+          && snapshot->value.first == snapshot->version
+          && snapshot->version >= last_version;
+        last_version = snapshot->version;
+      }
+      _exit(ok ? 0 : 1);
+    }
+    children.push_back(child);
+  }
+
+  pid_t const writer = fork();
+  BOOST_REQUIRE(writer >= 0);
+  if(writer == 0)
+  {
+    shm_mvcc<shm_pair> y{name.c_str()};
+    for(size_t n = 0; n < PUBLISHES; ++n)
+      y.update(increment);
+    _exit(0);
+  }
+  children.push_back(writer);
+
+  for(size_t n = 0; n < PUBLISHES; ++n)
+    x.update(increment);
+
+  for(auto child : children)
+  {
+    int status = 0;
+    BOOST_REQUIRE(waitpid(child, &status, 0) == child);
+    BOOST_REQUIRE(WIFEXITED(status));
+    BOOST_REQUIRE(WEXITSTATUS(status) == 0);
+  }
+
+  auto snapshot = x.current();
+  BOOST_REQUIRE(snapshot->version == 2 * PUBLISHES);
+  BOOST_REQUIRE(snapshot->value.first == 2 * PUBLISHES);
+
+  shm_mvcc<shm_pair>::remove(name.c_str());
+}
+
+typedef boost::mpl::list<
+  boost_shared_ptr_policy,
+  std_shared_ptr_policy,
+#ifdef __cpp_lib_atomic_shared_ptr
+  atomic_shared_ptr_policy,
+#endif
+  intrusive_ptr_policy
+  > pointer_policies;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_pointer_policy_snapshot_isolation, Policy, pointer_policies)
+{
+  mvcc<string, Policy> x{INIT};
+  auto snapshot1 = *x;
+  BOOST_REQUIRE(snapshot1 != nullptr);
+  BOOST_REQUIRE(snapshot1 == x.current());
+  BOOST_REQUIRE(snapshot1->version == 0);
+  BOOST_REQUIRE(snapshot1->value == INIT);
+
+  auto snapshot2 = x.overwrite(OVERWRITTEN);
+  BOOST_REQUIRE(snapshot2 == x.current());
+  BOOST_REQUIRE(snapshot2->version == 1);
+  BOOST_REQUIRE(snapshot2->value == OVERWRITTEN);
+
+  auto snapshot3 = x.update([](size_t version, string const &value) {
+      BOOST_REQUIRE(version == 1);
+      BOOST_REQUIRE(value == OVERWRITTEN);
+      return UPDATED;
+    });
+  BOOST_REQUIRE(snapshot3->version == 2);
+  BOOST_REQUIRE(snapshot3->value == UPDATED);
+
+  BOOST_REQUIRE(snapshot1 != snapshot2);
+  BOOST_REQUIRE(snapshot1->value == INIT);
+  BOOST_REQUIRE(snapshot2->value == OVERWRITTEN);
+
+  mvcc<string, Policy> y{x};
+  x.overwrite(DISTURBED);
+  BOOST_REQUIRE(y.current() == snapshot3);
+  y = x;
+  BOOST_REQUIRE(y.current()->value == DISTURBED);
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(test_pointer_policy_concurrent_updates, Policy, pointer_policies)
+{
+  size_t const UPDATERS = 4;
+  size_t const UPDATES = 1000;
+
+  mvcc<size_t, Policy> x{0};
+  atomic<bool> done{false};
+
+  auto reader =
+    async(launch::async,
+          [&] {
+            bool consistent = true;
+            while(!done)
+            {
+              auto snapshot = x.current();
+              consistent = consistent && snapshot->version == snapshot->value;
+            }
+            return consistent;
+          });
+
+  vector<future<void>> updaters;
+  for(size_t i = 0; i < UPDATERS; ++i)
+    updaters.push_back(
+      async(launch::async,
+            [&] {
+              for(size_t n = 0; n < UPDATES; ++n)
+                x.update([](size_t, size_t value) { return value + 1; });
+            }));
+  for(auto &u : updaters)
+    u.get();
+  done = true;
+
+  BOOST_REQUIRE(reader.get());
+  BOOST_REQUIRE(x.current()->version == UPDATERS * UPDATES);
+  BOOST_REQUIRE(x.current()->value == UPDATERS * UPDATES);
+}
+
+namespace
+{
+  struct counted
+  {
+    static atomic<int> instances;
+
+    counted() { ++instances; }
+    counted(counted const &) { ++instances; }
+    ~counted() { --instances; }
+  };
+
+  atomic<int> counted::instances{0};
+}
+
+// Snapshots go away along with the last reference to them.
+BOOST_AUTO_TEST_CASE(test_intrusive_ptr_policy_frees_snapshots)
+{
+  {
+    mvcc<counted, intrusive_ptr_policy> x;
+    auto first = x.current();
+    BOOST_REQUIRE(first.use_count() == 2);
+
+    x.overwrite(counted{});
+    x.overwrite(counted{});
+    BOOST_REQUIRE(counted::instances == 2);
+
+    first = nullptr;
+    BOOST_REQUIRE(counted::instances == 1);
+  }
+  BOOST_REQUIRE(counted::instances == 0);
+}
+
+// Loads racing stores that keep swapping the same two snapshots in and out,
+// so a load's pin may be moved onto a snapshot that is stored again before
+// the load drops it.
+BOOST_AUTO_TEST_CASE(test_intrusive_ptr_policy_loads_race_restores)
+{
+  size_t const READERS = 3;
+  size_t const ROUNDS = 1000000;
+
+  {
+    mvcc<counted, intrusive_ptr_policy> a;
+    mvcc<counted, intrusive_ptr_policy> b;
+    mvcc<counted, intrusive_ptr_policy> y{a};
+    atomic<bool> done{false};
+
+    vector<future<void>> readers;
+    for(size_t i = 0; i < READERS; ++i)
+      readers.push_back(
+        async(launch::async,
+              [&] {
+                while(!done)
+                  y.current();
+              }));
+
+    for(size_t n = 0; n < ROUNDS; ++n)
+    {
+      y = b;
+      y = a;
+    }
+    done = true;
+    for(auto &r : readers)
+      r.get();
+
+    // Held by a, y and here; by b and here.
+    BOOST_REQUIRE(a.current().use_count() == 3);
+    BOOST_REQUIRE(b.current().use_count() == 2);
+    BOOST_REQUIRE(counted::instances == 2);
+  }
+  BOOST_REQUIRE(counted::instances == 0);
+}
+
+namespace
+{
+  struct string_length
+  {
+    size_t operator()(size_t, string const &value) const
+    {
+      ++computations;
+      return value.size();
+    }
+
+    static atomic<size_t> computations;
+  };
+
+  atomic<size_t> string_length::computations{0};
+
+  // Fails while `fail` is set; the flag is static since derivations must
+  // be stateless.
+  struct make_counted
+  {
+    shared_ptr<counted> operator()(size_t, string const &) const
+    {
+      if(fail)
+        throw runtime_error{"derivation failed"};
+      return make_shared<counted>();
+    }
+
+    static bool fail;
+  };
+
+  bool make_counted::fail = false;
+}
+
+// A derived view is computed once per snapshot, however many readers ask
+// for it concurrently, and newer snapshots get their own.
+BOOST_AUTO_TEST_CASE(test_derived_view_is_computed_once_per_snapshot)
+{
+  size_t const READERS = 8;
+
+  mvcc<string> x{INIT};
+  auto snapshot = x.current();
+
+  vector<future<size_t const *>> readers;
+  for(size_t i = 0; i < READERS; ++i)
+    readers.push_back(
+      async(launch::async,
+            [&] {
+              return &x.current()->derived(string_length{});
+            }));
+
+  auto const *length = &snapshot->derived(string_length{});
+  BOOST_REQUIRE(*length == string{INIT}.size());
+  for(auto &r : readers)
+    BOOST_REQUIRE(r.get() == length);
+  BOOST_REQUIRE(string_length::computations == 1);
+
+  auto upper = snapshot->derived([](size_t version, string const &value) {
+      BOOST_REQUIRE(version == 0);
+      return value + "!";
+    });
+  BOOST_REQUIRE(upper == string{INIT} + "!");
+  BOOST_REQUIRE(string_length::computations == 1);
+
+  auto overwritten = x.overwrite(OVERWRITTEN);
+  BOOST_REQUIRE(overwritten->derived(string_length{}) == string{OVERWRITTEN}.size());
+  BOOST_REQUIRE(string_length::computations == 2);
+  BOOST_REQUIRE(snapshot->derived(string_length{}) == string{INIT}.size());
+  BOOST_REQUIRE(string_length::computations == 2);
+}
+
+// A derivation that throws leaves no view behind, so the next reader tries
+// again; views are freed along with their snapshot.
+BOOST_AUTO_TEST_CASE(test_derived_view_retries_after_exception_and_is_freed)
+{
+  int const instances = counted::instances;
+  {
+    mvcc<string> x{INIT};
+    auto snapshot = x.current();
+
+    make_counted::fail = true;
+    BOOST_CHECK_THROW(snapshot->derived(make_counted{}), runtime_error);
+    BOOST_REQUIRE(counted::instances == instances);
+
+    make_counted::fail = false;
+    auto const &view = snapshot->derived(make_counted{});
+    BOOST_REQUIRE(view != nullptr);
+    BOOST_REQUIRE(&snapshot->derived(make_counted{}) == &view);
+    BOOST_REQUIRE(counted::instances == instances + 1);
+
+    x.overwrite(OVERWRITTEN);
+    BOOST_REQUIRE(counted::instances == instances + 1);
+  }
+  BOOST_REQUIRE(counted::instances == instances);
+}
+
 BOOST_AUTO_TEST_SUITE_END()